@@ -0,0 +1,173 @@
+/**
+ * accept压测: 模拟SYN风暴 测量服务端每秒accept的连接数
+ * 每一轮fork一个服务端子进程 父进程的客户端线程每次发起一波非阻塞connect 全部建立后RST关闭
+ * clients*burst不超过listen的backlog(1024) 否则SYN被丢弃后要等1秒重传
+ * 服务端accept到的连接数通过共享内存计数 对比每次只accept一个/批量accept/每个subloop各自accept
+ *
+ * 用法: ./accept_bench [客户端线程数=1] [每波connect数=128] [每轮秒数=3] [subloop数=2]
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <chrono>
+
+#include "TcpServer.h"
+
+static void runServer(uint16_t port, int threads, int batch, bool perLoop, std::atomic<long> *accepted)
+{
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "AcceptBench");
+    server.setThreadNum(threads);
+    server.setAcceptBatch(batch);
+    server.setPerLoopAcceptors(perLoop);
+    server.setConnectionCallback([accepted](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            accepted->fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    server.setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp) {
+        buf->retrieveAll();
+    });
+    server.start();
+    loop.loop();
+}
+
+// 源地址在127.x.y.z中轮换: 服务端可能还没处理完上一个连接的RST 同一个四元组很快被复用的话
+// 新的SYN会撞上旧连接 要等1秒的SYN重传 测出来的就不是accept的速度了
+static int connectNonblocking(uint16_t port, int client, unsigned seq)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    sockaddr_in local = {};
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl((127u << 24) | ((client % 250 + 1) << 16) | ((seq / 250 % 250) << 8) | (seq % 250 + 1));
+    ::bind(fd, (const sockaddr *)&local, sizeof local);
+    InetAddress addr(port);
+    ::connect(fd, (const sockaddr *)addr.getSockAddr(), sizeof(sockaddr_in));
+    return fd;
+}
+
+// 以RST关闭 避免客户端堆积TIME_WAIT耗尽端口
+static void resetAndClose(int fd)
+{
+    struct linger lg = {1, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof lg);
+    ::close(fd);
+}
+
+// 一次发起burst个非阻塞connect(一波SYN) 等全部握手完成后RST关闭 返回成功建立的连接数
+static int connectBurst(uint16_t port, int client, unsigned &seq, int burst)
+{
+    std::vector<pollfd> pfds(burst);
+    for (int i = 0; i < burst; ++i)
+    {
+        pfds[i].fd = connectNonblocking(port, client, seq++);
+        pfds[i].events = POLLOUT;
+    }
+    int established = 0;
+    int pending = burst;
+    while (pending > 0 && ::poll(pfds.data(), pfds.size(), 3000) > 0)
+    {
+        for (pollfd &p : pfds)
+        {
+            if (p.fd >= 0 && p.revents)
+            {
+                int err = 0;
+                socklen_t len = sizeof err;
+                ::getsockopt(p.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                established += err == 0;
+                resetAndClose(p.fd);
+                p.fd = -1; // poll忽略负数fd
+                --pending;
+            }
+        }
+    }
+    for (pollfd &p : pfds)
+    {
+        if (p.fd >= 0)
+        {
+            resetAndClose(p.fd);
+        }
+    }
+    return established;
+}
+
+// 返回服务端每秒accept的连接数
+static double runRound(uint16_t port, int clients, int burst, int seconds, int threads, int batch, bool perLoop)
+{
+    std::atomic<long> *accepted = static_cast<std::atomic<long> *>(
+        ::mmap(nullptr, sizeof(std::atomic<long>), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    new (accepted) std::atomic<long>(0);
+
+    fflush(stdout); // 避免子进程重复输出缓冲区中的内容
+    pid_t pid = ::fork();
+    if (pid == 0)
+    {
+        // 服务端日志太多 直接丢弃
+        freopen("/dev/null", "w", stdout);
+        runServer(port, threads, batch, perLoop, accepted);
+        _exit(0);
+    }
+
+    // 等子进程开始监听
+    unsigned probeSeq = 0;
+    while (connectBurst(port, 0, probeSeq, 1) == 0)
+    {
+        ::usleep(20 * 1000);
+    }
+
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < clients; ++i)
+    {
+        workers.emplace_back([port, i, burst, &stop]() {
+            unsigned seq = 0;
+            while (!stop)
+            {
+                connectBurst(port, i + 1, seq, burst);
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200)); // 预热
+    long begin = accepted->load();
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    long end = accepted->load();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    stop = true;
+    for (std::thread &t : workers)
+    {
+        t.join();
+    }
+    ::kill(pid, SIGKILL);
+    ::waitpid(pid, nullptr, 0);
+    ::munmap(accepted, sizeof(std::atomic<long>));
+    return (end - begin) / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    int clients = argc > 1 ? atoi(argv[1]) : 1;
+    int burst = argc > 2 ? atoi(argv[2]) : 128;
+    int seconds = argc > 3 ? atoi(argv[3]) : 3;
+    int threads = argc > 4 ? atoi(argv[4]) : 2;
+
+    printf("clients=%d burst=%d seconds=%d subloops=%d\n", clients, burst, seconds, threads);
+    double single = runRound(9211, clients, burst, seconds, threads, 1, false);
+    printf("batch=1            : %.0f accepts/s\n", single);
+    double batched = runRound(9212, clients, burst, seconds, threads, Acceptor::kDefaultAcceptBatch, false);
+    printf("batch=%-2d           : %.0f accepts/s (%.2fx)\n", Acceptor::kDefaultAcceptBatch, batched, batched / single);
+    double perLoop = runRound(9213, clients, burst, seconds, threads, Acceptor::kDefaultAcceptBatch, true);
+    printf("batch=%-2d per-loop  : %.0f accepts/s (%.2fx)\n", Acceptor::kDefaultAcceptBatch, perLoop, perLoop / single);
+    return 0;
+}
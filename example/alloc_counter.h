@@ -0,0 +1,109 @@
+#pragma once
+
+/**
+ * 堆分配压测共用: 替换全局operator new计数 服务端日志重定向到临时文件 按行数和每行的分配次数扣除日志本身的分配
+ * 定义了全局的operator new/delete 每个程序只能有一个源文件包含
+ *
+ * 用法:
+ *   FILE *logFile = redirectLogToTempFile();
+ *   double perLine = measureAllocsPerLogLine(logFile, [](int i) { LOG_INFO(...); });
+ *   AllocCount before = allocCount(logFile);
+ *   ... 被测代码 ...
+ *   AllocSplit split = splitAllocs(allocCount(logFile) - before, n, perLine); // 平均到n次操作
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+#include <new>
+
+static std::atomic<long> g_allocs(0);
+
+void *operator new(size_t size)
+{
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    void *p = ::malloc(size ? size : 1);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+void operator delete(void *p) noexcept { ::free(p); }
+void operator delete(void *p, size_t) noexcept { ::free(p); }
+
+inline long countLines(FILE *file)
+{
+    fflush(stdout);
+    long lines = 0;
+    char buf[4096];
+    ::rewind(file);
+    size_t n;
+    while ((n = ::fread(buf, 1, sizeof buf, file)) > 0)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            lines += buf[i] == '\n';
+        }
+    }
+    return lines;
+}
+
+// 某一时刻的分配次数和日志行数 两次之差就是一段代码的分配次数和它打印的日志行数
+struct AllocCount
+{
+    long allocs;
+    long logLines;
+};
+
+inline AllocCount operator-(const AllocCount &a, const AllocCount &b)
+{
+    AllocCount d = {a.allocs - b.allocs, a.logLines - b.logLines};
+    return d;
+}
+
+inline AllocCount allocCount(FILE *logFile)
+{
+    long lines = countLines(logFile); // 先数行 countLines本身不分配
+    AllocCount c = {g_allocs.load(), lines};
+    return c;
+}
+
+// 日志(stdout)写到临时文件里 只用来数行数
+inline FILE *redirectLogToTempFile()
+{
+    FILE *logFile = ::tmpfile();
+    fflush(stdout);
+    ::dup2(::fileno(logFile), STDOUT_FILENO);
+    return logFile;
+}
+
+// 每行日志的分配次数 logLine(i)打印一行 内容长度应该和被测代码的日志差不多
+template <typename LogLine>
+inline double measureAllocsPerLogLine(FILE *logFile, LogLine logLine)
+{
+    AllocCount before = allocCount(logFile);
+    for (int i = 0; i < 1000; ++i)
+    {
+        logLine(i);
+    }
+    AllocCount d = allocCount(logFile) - before;
+    return static_cast<double>(d.allocs) / d.logLines;
+}
+
+// 平均到每次操作的分配次数 拆成日志和库本身两部分
+struct AllocSplit
+{
+    double total;
+    double logging;
+    double library;
+};
+
+inline AllocSplit splitAllocs(const AllocCount &d, double operations, double allocsPerLine)
+{
+    AllocSplit s;
+    s.total = d.allocs / operations;
+    s.logging = d.logLines * allocsPerLine / operations;
+    s.library = s.total - s.logging;
+    return s;
+}
@@ -0,0 +1,144 @@
+/**
+ * 连接建立/关闭的堆分配压测: 替换全局operator new计数 统计每个连接从accept到销毁的分配次数
+ * 客户端线程每一波同时发起burst个connect 服务端全部建立后RST关闭 等服务端全部销毁后开始下一波
+ * 第一波是冷启动(连接池为空) 之后各波复用归还的块 reserve=burst时第一波也不需要分配
+ * 日志本身也在分配内存: 服务端日志重定向到临时文件 按行数和每行的分配次数扣除 单独列出
+ *
+ * 用法: ./conn_alloc_bench [波数=20] [每波连接数=256] [subloop数=1]
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "TcpServer.h"
+#include "ConnectionPool.h"
+#include "Logger.h"
+#include "alloc_counter.h"
+
+// 以RST关闭 服务端立即看到连接断开 客户端也不堆积TIME_WAIT
+static void resetAndClose(int fd)
+{
+    struct linger lg = {1, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof lg);
+    ::close(fd);
+}
+
+// 在客户端线程中运行 返回每一波的分配次数和服务端日志行数
+static std::vector<AllocCount> runWaves(uint16_t port, int waves, int burst, FILE *logFile,
+                                        const std::vector<EventLoop *> &loops, const std::atomic<long> &established)
+{
+    std::vector<AllocCount> results;
+    results.reserve(waves);
+    std::vector<pollfd> pfds(burst);
+    InetAddress addr(port);
+    for (int w = 0; w < waves; ++w)
+    {
+        AllocCount before = allocCount(logFile);
+        for (int i = 0; i < burst; ++i)
+        {
+            pfds[i].fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+            pfds[i].events = POLLOUT;
+            ::connect(pfds[i].fd, (const sockaddr *)addr.getSockAddr(), sizeof(sockaddr_in));
+        }
+        // 握手完成后还要等服务端accept并建立连接 否则RST可能先于accept到达
+        while (established.load() < static_cast<long>(w + 1) * burst)
+        {
+            ::usleep(1000);
+        }
+        for (pollfd &p : pfds)
+        {
+            resetAndClose(p.fd);
+        }
+        for (;;)
+        {
+            int64_t alive = 0;
+            for (EventLoop *loop : loops)
+            {
+                alive += loop->numConnections() + loop->connectionPool()->stats().inUse;
+            }
+            if (alive == 0)
+            {
+                break;
+            }
+            ::usleep(1000);
+        }
+        results.push_back(allocCount(logFile) - before);
+    }
+    return results;
+}
+
+static void runRound(uint16_t port, int waves, int burst, int threads, size_t reserve, FILE *logFile, double allocsPerLine)
+{
+    std::vector<AllocCount> results;
+    std::vector<EventLoop *> loops;
+    std::atomic<long> established(0);
+    {
+        EventLoop loop;
+        TcpServer server(&loop, InetAddress(port), "ConnAllocBench");
+        server.setThreadNum(threads);
+        server.reserveConnections(reserve);
+        server.setThreadInitCallback([&loops](EventLoop *ioLoop) { loops.push_back(ioLoop); });
+        server.setConnectionCallback([&established](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                established.fetch_add(1);
+            }
+        });
+        server.setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp) {
+            buf->retrieveAll();
+        });
+        server.start();
+        if (threads == 0)
+        {
+            loops.push_back(&loop);
+        }
+
+        std::thread client([&]() {
+            ::usleep(100 * 1000); // 等待开始监听和预分配完成
+            results = runWaves(port, waves, burst, logFile, loops, established);
+            loop.quit();
+        });
+        loop.loop();
+        client.join();
+    }
+
+    AllocCount steady = {0, 0};
+    for (size_t i = 1; i < results.size(); ++i)
+    {
+        steady.allocs += results[i].allocs;
+        steady.logLines += results[i].logLines;
+    }
+    AllocSplit cold = splitAllocs(results[0], burst, allocsPerLine);
+    AllocSplit warm = splitAllocs(steady, static_cast<double>(burst) * (waves - 1), allocsPerLine);
+    fprintf(stderr, "reserve=%-5lu first wave : %6.2f allocs/conn (logging %5.2f, library %5.2f)\n",
+            reserve, cold.total, cold.logging, cold.library);
+    fprintf(stderr, "reserve=%-5lu later waves: %6.2f allocs/conn (logging %5.2f, library %5.2f)\n",
+            reserve, warm.total, warm.logging, warm.library);
+}
+
+int main(int argc, char *argv[])
+{
+    int waves = argc > 1 ? atoi(argv[1]) : 20;
+    int burst = argc > 2 ? atoi(argv[2]) : 256;
+    int threads = argc > 3 ? atoi(argv[3]) : 1;
+    if (waves < 2)
+    {
+        waves = 2;
+    }
+
+    FILE *logFile = redirectLogToTempFile();
+    double allocsPerLine = measureAllocsPerLogLine(logFile, [](int i) {
+        LOG_INFO("TcpConnection::dtor[ConnAllocBench-0.0.0.0:9231#1.%d.0] at fd=%d\n", i, i);
+    });
+
+    fprintf(stderr, "waves=%d burst=%d subloops=%d TcpConnection=%lu bytes pool block=%lu bytes logging=%.1f allocs/line\n",
+            waves, burst, threads, sizeof(TcpConnection), ConnectionPool::kBlockSize, allocsPerLine);
+    runRound(9231, waves, burst, threads, 0, logFile, allocsPerLine);
+    runRound(9232, waves, burst, threads, burst, logFile, allocsPerLine);
+    return 0;
+}
@@ -0,0 +1,157 @@
+/**
+ * 主动连接压测: 测量TcpClient每秒建立的连接数
+ * fork一个服务端子进程 父进程的TcpClient按轮询分散到EventLoopThreadPool的各个subloop
+ * 每一波同时对全部TcpClient调用connect 全部建立后disconnect 等全部断开后开始下一波
+ * 最后一轮开启自动重连: 服务端收到消息后关闭连接 测量全部客户端重新连上的时间
+ * 每波的连接数不超过listen的backlog(1024) 否则SYN被丢弃后要等1秒重传
+ *
+ * 用法: ./connect_bench [每波客户端数=512] [波数=10] [subloop数=4]
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "TcpServer.h"
+#include "TcpClient.h"
+#include "EventLoopThreadPool.h"
+
+static void runServer(uint16_t port)
+{
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "ConnectBench");
+    server.setThreadNum(2);
+    server.setConnectionCallback([](const TcpConnectionPtr &) {});
+    // 收到消息就关闭 用来触发客户端的自动重连
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        buf->retrieveAll();
+        conn->forceClose();
+    });
+    server.start();
+    loop.loop();
+}
+
+static void waitFor(const std::atomic<long> &counter, long target)
+{
+    while (counter.load() < target)
+    {
+        ::usleep(200);
+    }
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 输出每秒建立的连接数和自动重连的速度
+static void runRound(uint16_t port, int clientsPerWave, int waves, int threads)
+{
+    fflush(stdout); // 避免子进程重复输出缓冲区中的内容
+    pid_t pid = ::fork();
+    if (pid == 0)
+    {
+        runServer(port);
+        _exit(0);
+    }
+    ::usleep(200 * 1000); // 等子进程开始监听
+
+    EventLoop baseLoop;
+    EventLoopThreadPool pool(&baseLoop, "ConnectBenchClient");
+    pool.setThreadNum(threads);
+    pool.start();
+
+    std::atomic<long> up(0);
+    std::atomic<long> down(0);
+    std::vector<std::unique_ptr<TcpClient>> clients;
+    for (int i = 0; i < clientsPerWave; ++i)
+    {
+        // 每个后端一个TcpClient 按轮询分到各个subloop
+        TcpClient *client = new TcpClient(pool.getNextLoop(), InetAddress(port), "ConnectBenchClient");
+        client->setConnectionCallback([&up, &down](const TcpConnectionPtr &conn) {
+            if (conn->connected())
+            {
+                up.fetch_add(1);
+            }
+            else
+            {
+                down.fetch_add(1);
+            }
+        });
+        client->setMessageCallback([](const TcpConnectionPtr &, Buffer *buf, Timestamp) { buf->retrieveAll(); });
+        clients.emplace_back(client);
+    }
+
+    double connectSeconds = 0;
+    for (int w = 0; w < waves; ++w)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (auto &client : clients)
+        {
+            client->connect();
+        }
+        waitFor(up, static_cast<long>(w + 1) * clientsPerWave);
+        connectSeconds += secondsSince(start);
+
+        for (auto &client : clients)
+        {
+            client->disconnect();
+        }
+        waitFor(down, static_cast<long>(w + 1) * clientsPerWave);
+    }
+    long connects = static_cast<long>(waves) * clientsPerWave;
+    fprintf(stderr, "subloops=%d connect      : %8.0f connections/s (%d waves of %d)\n",
+            threads, connects / connectSeconds, waves, clientsPerWave);
+
+    // 自动重连: 连上之后各发一个字节 服务端关闭连接 客户端立即重新连接
+    for (auto &client : clients)
+    {
+        client->enableRetry();
+        client->connect();
+    }
+    long base = up.load();
+    waitFor(up, base + clientsPerWave);
+    auto start = std::chrono::steady_clock::now();
+    for (auto &client : clients)
+    {
+        TcpConnectionPtr conn = client->connection();
+        if (conn)
+        {
+            conn->send(std::string("x"));
+        }
+    }
+    waitFor(up, base + 2L * clientsPerWave);
+    double reconnectSeconds = secondsSince(start);
+    fprintf(stderr, "subloops=%d reconnect    : %8.0f connections/s\n", threads, clientsPerWave / reconnectSeconds);
+
+    // 连接还在时TcpClient要在所属loop线程中析构
+    for (auto &client : clients)
+    {
+        client->stop();
+        TcpClient *raw = client.release();
+        raw->getLoop()->runInLoop([raw]() { delete raw; });
+    }
+    waitFor(down, up.load());
+
+    ::kill(pid, SIGKILL);
+    ::waitpid(pid, nullptr, 0);
+}
+
+int main(int argc, char *argv[])
+{
+    int clientsPerWave = argc > 1 ? atoi(argv[1]) : 512;
+    int waves = argc > 2 ? atoi(argv[2]) : 10;
+    int threads = argc > 3 ? atoi(argv[3]) : 4;
+
+    // 日志太多 直接丢弃 结果输出到stderr
+    freopen("/dev/null", "w", stdout);
+    runRound(9251, clientsPerWave, waves, 1);
+    runRound(9252, clientsPerWave, waves, threads);
+    return 0;
+}
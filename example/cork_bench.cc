@@ -0,0 +1,192 @@
+/**
+ * cork模式压测: RPC风格的服务端对每个请求分三次send(头部/正文/尾部) 客户端每次流水线发出多个请求
+ * 分别在普通模式和cork模式下fork服务端子进程 通过/proc/<pid>/io的syscw统计服务端的write类系统调用次数
+ * (其中包含唤醒用的eventfd写入)
+ *
+ * 用法: ./cork_bench [连接数=16] [每轮秒数=3] [流水线深度=8] [正文字节数=64] [subloop数=2]
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <string>
+
+#include "TcpServer.h"
+
+static const size_t kRequestSize = 8;
+
+static void runServer(uint16_t port, int threads, bool cork, size_t bodySize)
+{
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "CorkBench");
+    server.setThreadNum(threads);
+    server.setCork(cork);
+    server.setConnectionCallback([](const TcpConnectionPtr &conn) {
+        if (conn->connected())
+        {
+            conn->setTcpNoDelay(true);
+        }
+    });
+    const std::string body(bodySize, 'b');
+    server.setMessageCallback([body](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        while (buf->readableBytes() >= kRequestSize)
+        {
+            buf->retrieve(kRequestSize);
+            conn->send(std::string("RSP:"));
+            conn->send(body);
+            conn->send(std::string("\r\n"));
+        }
+    });
+    server.start();
+    loop.loop();
+}
+
+static long writeSyscalls(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof path, "/proc/%d/io", pid);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+    {
+        return -1;
+    }
+    char line[128];
+    long syscw = -1;
+    while (fgets(line, sizeof line, fp))
+    {
+        if (sscanf(line, "syscw: %ld", &syscw) == 1)
+        {
+            break;
+        }
+    }
+    fclose(fp);
+    return syscw;
+}
+
+static int connectTo(uint16_t port)
+{
+    for (int retry = 0; retry < 100; ++retry)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        InetAddress addr(port);
+        if (::connect(fd, (const sockaddr *)addr.getSockAddr(), sizeof(sockaddr_in)) == 0)
+        {
+            int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+            return fd;
+        }
+        ::close(fd);
+        ::usleep(20 * 1000); // 等子进程开始监听
+    }
+    return -1;
+}
+
+struct Result
+{
+    double requestsPerSec;
+    double writesPerRequest;
+};
+
+static Result runRound(bool cork, uint16_t port, int conns, int seconds, int depth, size_t bodySize, int threads)
+{
+    fflush(stdout);
+    pid_t pid = ::fork();
+    if (pid == 0)
+    {
+        freopen("/dev/null", "w", stdout);
+        runServer(port, threads, cork, bodySize);
+        _exit(0);
+    }
+
+    std::vector<int> fds;
+    for (int i = 0; i < conns; ++i)
+    {
+        int fd = connectTo(port);
+        if (fd < 0)
+        {
+            fprintf(stderr, "connect failed\n");
+            exit(1);
+        }
+        fds.push_back(fd);
+    }
+
+    const size_t responseSize = 4 + bodySize + 2;
+    std::atomic<bool> stop(false);
+    std::atomic<long> requests(0);
+    std::vector<std::thread> clients;
+    long before = writeSyscalls(pid);
+    for (int fd : fds)
+    {
+        clients.emplace_back([fd, depth, responseSize, &stop, &requests]() {
+            std::string batch(kRequestSize * depth, 'q');
+            std::vector<char> buf(responseSize * depth);
+            long n = 0;
+            while (!stop)
+            {
+                if (::write(fd, batch.data(), batch.size()) != (ssize_t)batch.size())
+                {
+                    break;
+                }
+                size_t got = 0;
+                while (got < buf.size())
+                {
+                    ssize_t r = ::read(fd, buf.data() + got, buf.size() - got);
+                    if (r <= 0)
+                    {
+                        return;
+                    }
+                    got += r;
+                }
+                n += depth;
+            }
+            requests += n;
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for (std::thread &t : clients)
+    {
+        t.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    long after = writeSyscalls(pid);
+
+    for (int fd : fds)
+    {
+        ::close(fd);
+    }
+    ::kill(pid, SIGKILL);
+    ::waitpid(pid, nullptr, 0);
+
+    Result result;
+    result.requestsPerSec = requests / elapsed;
+    result.writesPerRequest = requests > 0 ? static_cast<double>(after - before) / requests : 0;
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    int conns = argc > 1 ? atoi(argv[1]) : 16;
+    int seconds = argc > 2 ? atoi(argv[2]) : 3;
+    int depth = argc > 3 ? atoi(argv[3]) : 8;
+    size_t bodySize = argc > 4 ? atoi(argv[4]) : 64;
+    int threads = argc > 5 ? atoi(argv[5]) : 2;
+
+    printf("connections=%d seconds=%d depth=%d body=%lu subloops=%d\n", conns, seconds, depth, bodySize, threads);
+    Result plain = runRound(false, 9211, conns, seconds, depth, bodySize, threads);
+    printf("no cork : %.0f requests/s  %.3f server writes/request\n", plain.requestsPerSec, plain.writesPerRequest);
+    Result corked = runRound(true, 9212, conns, seconds, depth, bodySize, threads);
+    printf("cork    : %.0f requests/s  %.3f server writes/request (%.2fx throughput)\n",
+           corked.requestsPerSec, corked.writesPerRequest, corked.requestsPerSec / plain.requestsPerSec);
+    return 0;
+}
@@ -0,0 +1,153 @@
+/**
+ * echo压测: 对比EPollPoller和IoUringPoller
+ * 每一轮fork一个echo服务端子进程(通过环境变量选择Poller) 父进程用多个客户端线程做ping-pong
+ *
+ * 用法: ./echo_bench [连接数=64] [每轮秒数=5] [消息字节数=64] [subloop数=2]
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <string>
+
+#include "TcpServer.h"
+#include "IoUringPoller.h"
+
+static void runServer(uint16_t port, int threads)
+{
+    EventLoop loop;
+    TcpServer server(&loop, InetAddress(port), "EchoBench");
+    server.setThreadNum(threads);
+    server.setConnectionCallback([](const TcpConnectionPtr &) {});
+    server.setMessageCallback([](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+        conn->send(buf->retrieveAllAsString());
+    });
+    server.start();
+    loop.loop();
+}
+
+static int connectTo(uint16_t port)
+{
+    for (int retry = 0; retry < 100; ++retry)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        InetAddress addr(port);
+        if (::connect(fd, (const sockaddr *)addr.getSockAddr(), sizeof(sockaddr_in)) == 0)
+        {
+            int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+            return fd;
+        }
+        ::close(fd);
+        ::usleep(20 * 1000); // 等子进程开始监听
+    }
+    return -1;
+}
+
+// 返回每秒完成的往返次数
+static double runRound(const char *pollerEnv, uint16_t port, int conns, int seconds, size_t msgSize, int threads)
+{
+    fflush(stdout); // 避免子进程重复输出缓冲区中的内容
+    pid_t pid = ::fork();
+    if (pid == 0)
+    {
+        if (pollerEnv)
+        {
+            ::setenv(pollerEnv, "1", 1);
+        }
+        // 服务端日志太多 直接丢弃
+        freopen("/dev/null", "w", stdout);
+        runServer(port, threads);
+        _exit(0);
+    }
+
+    std::vector<int> fds;
+    for (int i = 0; i < conns; ++i)
+    {
+        int fd = connectTo(port);
+        if (fd < 0)
+        {
+            fprintf(stderr, "connect failed\n");
+            exit(1);
+        }
+        fds.push_back(fd);
+    }
+
+    std::atomic<bool> stop(false);
+    std::atomic<long> roundTrips(0);
+    std::vector<std::thread> clients;
+    for (int fd : fds)
+    {
+        clients.emplace_back([fd, msgSize, &stop, &roundTrips]() {
+            std::string msg(msgSize, 'x');
+            std::vector<char> buf(msgSize);
+            long n = 0;
+            while (!stop)
+            {
+                if (::write(fd, msg.data(), msg.size()) != (ssize_t)msg.size())
+                {
+                    break;
+                }
+                size_t got = 0;
+                while (got < msgSize)
+                {
+                    ssize_t r = ::read(fd, buf.data() + got, msgSize - got);
+                    if (r <= 0)
+                    {
+                        return;
+                    }
+                    got += r;
+                }
+                ++n;
+            }
+            roundTrips += n;
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for (std::thread &t : clients)
+    {
+        t.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (int fd : fds)
+    {
+        ::close(fd);
+    }
+    ::kill(pid, SIGKILL);
+    ::waitpid(pid, nullptr, 0);
+    return roundTrips / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    int conns = argc > 1 ? atoi(argv[1]) : 64;
+    int seconds = argc > 2 ? atoi(argv[2]) : 5;
+    size_t msgSize = argc > 3 ? atoi(argv[3]) : 64;
+    int threads = argc > 4 ? atoi(argv[4]) : 2;
+
+    printf("connections=%d seconds=%d msgSize=%lu subloops=%d\n", conns, seconds, msgSize, threads);
+    double epollRate = runRound(nullptr, 9201, conns, seconds, msgSize, threads);
+    printf("epoll    : %.0f round trips/s\n", epollRate);
+    if (IoUringPoller::isSupported())
+    {
+        double uringRate = runRound("MUDUO_USE_IOURING", 9202, conns, seconds, msgSize, threads);
+        printf("io_uring : %.0f round trips/s (%.2fx)\n", uringRate, uringRate / epollRate);
+    }
+    else
+    {
+        printf("io_uring : not supported by this kernel\n");
+    }
+    return 0;
+}
@@ -0,0 +1,152 @@
+/**
+ * EventLoop任务队列压测
+ * 1. 队列本身: 多个生产者线程 + 一个消费者线程 对比 mutex+vector(原实现) 与 无锁MpscQueue
+ * 2. EventLoop::queueInLoop: 多个生产者线程向多个subloop投递任务 统计每秒执行的任务数
+ *
+ * 用法: ./queue_bench [生产者数=4] [loop数=2] [每个生产者的任务数=1000000]
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "MpscQueue.h"
+
+using Functor = std::function<void()>;
+
+// 原来EventLoop中的实现: 加锁push_back 消费者加锁swap
+class MutexQueue
+{
+public:
+    bool push(Functor cb)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        bool wasEmpty = functors_.empty();
+        functors_.emplace_back(std::move(cb));
+        return wasEmpty;
+    }
+
+    template <typename Func>
+    size_t consumeAll(Func &&func)
+    {
+        std::vector<Functor> functors;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            functors.swap(functors_);
+        }
+        for (Functor &functor : functors)
+        {
+            func(functor);
+        }
+        return functors.size();
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<Functor> functors_;
+};
+
+template <typename Queue>
+static double benchQueue(int producers, long perProducer)
+{
+    Queue queue;
+    long executed = 0;
+    const long total = producers * perProducer;
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread consumer([&]() {
+        long consumed = 0;
+        while (consumed < total)
+        {
+            consumed += queue.consumeAll([&](Functor &f) { f(); });
+        }
+    });
+    std::vector<std::thread> threads;
+    for (int i = 0; i < producers; ++i)
+    {
+        threads.emplace_back([&]() {
+            for (long j = 0; j < perProducer; ++j)
+            {
+                queue.push([&executed]() { ++executed; }); // 只有消费者线程执行 不需要原子操作
+            }
+        });
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    consumer.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (executed != total)
+    {
+        fprintf(stderr, "lost tasks: %ld/%ld\n", executed, total);
+    }
+    return total / elapsed;
+}
+
+static double benchEventLoop(int producers, int loops, long perProducer)
+{
+    std::vector<std::unique_ptr<EventLoopThread>> loopThreads;
+    std::vector<EventLoop *> eventLoops;
+    for (int i = 0; i < loops; ++i)
+    {
+        loopThreads.emplace_back(new EventLoopThread());
+        eventLoops.push_back(loopThreads.back()->startLoop());
+    }
+
+    std::atomic<long> executed(0);
+    const long total = producers * perProducer;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < producers; ++i)
+    {
+        threads.emplace_back([&, i]() {
+            for (long j = 0; j < perProducer; ++j)
+            {
+                eventLoops[(i + j) % loops]->queueInLoop([&executed]() {
+                    executed.fetch_add(1, std::memory_order_relaxed);
+                });
+            }
+        });
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    while (executed.load(std::memory_order_relaxed) < total)
+    {
+        std::this_thread::yield();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return total / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    int producers = argc > 1 ? atoi(argv[1]) : 4;
+    int loops = argc > 2 ? atoi(argv[2]) : 2;
+    long perProducer = argc > 3 ? atol(argv[3]) : 1000000;
+
+    printf("producers=%d loops=%d tasks/producer=%ld\n", producers, loops, perProducer);
+    double mutexRate = benchQueue<MutexQueue>(producers, perProducer);
+    double mpscRate = benchQueue<MpscQueue<Functor>>(producers, perProducer);
+    printf("queue mutex+vector : %.0f tasks/s\n", mutexRate);
+    printf("queue MpscQueue    : %.0f tasks/s (%.2fx)\n", mpscRate, mpscRate / mutexRate);
+
+    // EventLoop的日志会输出到stdout 重定向掉
+    fflush(stdout);
+    FILE *out = fdopen(dup(fileno(stdout)), "w");
+    freopen("/dev/null", "w", stdout);
+    double loopRate = benchEventLoop(producers, loops, perProducer);
+    fprintf(out, "EventLoop::queueInLoop %dx%d : %.0f tasks/s\n", producers, loops, loopRate);
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,169 @@
+/**
+ * 接收路径压测: 对比原来的readFd(每次清零64KB栈上extrabuf)和使用loop共享接收区的readFd
+ * 一个线程通过TCP回环不停地写 主线程poll到可读后调用readFd 然后把数据全部取走(模拟onMessage)
+ * 统计readv系统调用次数和readFd内部的每字节周期数(x86上用rdtsc 其他平台是纳秒)
+ *
+ * 用法: ./recv_bench [总MB数=512] [每次写入KB数=256]
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <thread>
+#include <chrono>
+#include <string>
+
+#include "EventLoop.h"
+#include "Buffer.h"
+#include "ReceiveArena.h"
+#include "InetAddress.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static uint64_t cycles() { return __rdtsc(); }
+static const char *kUnit = "cycles/byte";
+#else
+static uint64_t cycles()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+static const char *kUnit = "ns/byte";
+#endif
+
+// 原来的Buffer::readFd 每次调用都把64KB栈空间清零
+static ssize_t legacyReadFd(Buffer &buf, int fd, int *saveErrno)
+{
+    char extrabuf[65536] = {0};
+    struct iovec vec[2];
+    const size_t writable = buf.writableBytes();
+    vec[0].iov_base = buf.beginWrite();
+    vec[0].iov_len = writable;
+    vec[1].iov_base = extrabuf;
+    vec[1].iov_len = sizeof(extrabuf);
+    const int iovcnt = (writable < sizeof(extrabuf)) ? 2 : 1;
+    const ssize_t n = ::readv(fd, vec, iovcnt);
+    if (n < 0)
+    {
+        *saveErrno = errno;
+    }
+    else if (static_cast<size_t>(n) <= writable)
+    {
+        buf.hasWritten(n);
+    }
+    else
+    {
+        buf.hasWritten(writable);
+        buf.append(extrabuf, n - writable);
+    }
+    return n;
+}
+
+static void connectedPair(int *reader, int *writer)
+{
+    int listenfd = ::socket(AF_INET, SOCK_STREAM, 0);
+    InetAddress addr(0);
+    ::bind(listenfd, (const sockaddr *)addr.getSockAddr(), sizeof(sockaddr_in));
+    ::listen(listenfd, 1);
+    sockaddr_in bound;
+    socklen_t len = sizeof bound;
+    ::getsockname(listenfd, (sockaddr *)&bound, &len);
+    *writer = ::socket(AF_INET, SOCK_STREAM, 0);
+    ::connect(*writer, (const sockaddr *)&bound, sizeof bound);
+    *reader = ::accept(listenfd, nullptr, nullptr);
+    ::close(listenfd);
+}
+
+struct Result
+{
+    long reads;
+    double unitsPerByte;
+    double seconds;
+};
+
+// arena为空时使用原来的readFd
+static Result runRound(size_t totalBytes, size_t chunk, Buffer &buf, ReceiveArena *arena)
+{
+    int reader, writer;
+    connectedPair(&reader, &writer);
+
+    std::thread producer([writer, totalBytes, chunk]() {
+        std::string data(chunk, 'x');
+        size_t sent = 0;
+        while (sent < totalBytes)
+        {
+            ssize_t n = ::write(writer, data.data(), std::min(chunk, totalBytes - sent));
+            if (n <= 0)
+            {
+                break;
+            }
+            sent += n;
+        }
+        ::close(writer);
+    });
+
+    Result result = {0, 0, 0};
+    uint64_t spent = 0;
+    size_t received = 0;
+    auto start = std::chrono::steady_clock::now();
+    pollfd pfd = {reader, POLLIN, 0};
+    while (::poll(&pfd, 1, -1) > 0)
+    {
+        int savedErrno = 0;
+        uint64_t begin = cycles();
+        ssize_t n = arena ? buf.readFd(reader, &savedErrno, arena) : legacyReadFd(buf, reader, &savedErrno);
+        spent += cycles() - begin;
+        if (n <= 0)
+        {
+            break;
+        }
+        ++result.reads;
+        received += n;
+        buf.retrieveAll();
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.unitsPerByte = received ? static_cast<double>(spent) / received : 0;
+    producer.join();
+    ::close(reader);
+    return result;
+}
+
+static void print(const char *name, const Result &r, size_t totalBytes)
+{
+    printf("%-18s: %7ld readv (%6.1f per MB)  %.3f %s  %.0f MB/s\n",
+           name, r.reads, r.reads / (totalBytes / 1048576.0), r.unitsPerByte, kUnit,
+           totalBytes / 1048576.0 / r.seconds);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t totalBytes = (argc > 1 ? atol(argv[1]) : 512) * 1024 * 1024;
+    size_t chunk = (argc > 2 ? atol(argv[2]) : 256) * 1024;
+    printf("total=%luMB chunk=%luKB\n", totalBytes >> 20, chunk >> 10);
+
+    EventLoop loop; // 只用它的BufferPool和ReceiveArena 在本线程中使用
+    {
+        Buffer buf;
+        print("before linear", runRound(totalBytes, chunk, buf, nullptr), totalBytes);
+    }
+    {
+        Buffer buf;
+        buf.setChained(true);
+        print("before chained", runRound(totalBytes, chunk, buf, nullptr), totalBytes);
+    }
+    {
+        Buffer buf(loop.bufferPool());
+        print("arena linear", runRound(totalBytes, chunk, buf, loop.receiveArena()), totalBytes);
+    }
+    {
+        Buffer buf(loop.bufferPool());
+        buf.setChained(true);
+        print("arena chained", runRound(totalBytes, chunk, buf, loop.receiveArena()), totalBytes);
+    }
+    printf("arena capacity at exit: %luKB\n", loop.receiveArena()->capacity() >> 10);
+    return 0;
+}
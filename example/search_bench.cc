@@ -0,0 +1,133 @@
+/**
+ * 分隔符查找压测: 在不同大小的缓冲区里找末尾的分隔符(最坏情况 需要扫描全部数据)
+ * 对比std::search、memchr/memmem和ByteSearch各级实现(scalar/sse2/avx2)的吞吐量
+ * dense行的文本中每32个字节有一个单独的\r(后面不是\n) 标量实现要在每个\r处重新开始memchr
+ * 最后模拟HTTP头部每次收到64字节时反复查找\r\n\r\n 对比从头扫描和增量查找扫描的总字节数
+ *
+ * 用法: ./search_bench [每项扫描的总MB数=2048]
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "Buffer.h"
+#include "ByteSearch.h"
+
+// 防止编译器把查找结果优化掉
+static volatile size_t g_sink;
+
+template <typename Find>
+static double measure(const std::string &data, size_t totalBytes, Find find)
+{
+    const char *begin = data.data();
+    const char *end = begin + data.size();
+    size_t rounds = std::max<size_t>(1, totalBytes / data.size());
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < rounds; ++i)
+    {
+        g_sink = find(begin, end) - begin;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return rounds * data.size() / seconds / (1024.0 * 1024 * 1024);
+}
+
+// 随机的可打印文本 末尾是分隔符 crEvery不为0时每crEvery个字节放一个单独的\r
+static std::string makeText(size_t size, const std::string &tail, size_t crEvery = 0)
+{
+    std::string text(size - tail.size(), ' ');
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        text[i] = static_cast<char>('!' + rand() % 90); // 不包含\r\n
+        if (crEvery != 0 && i % crEvery == crEvery - 1)
+        {
+            text[i] = '\r';
+        }
+    }
+    return text + tail;
+}
+
+static void benchSize(size_t size, size_t totalBytes, size_t crEvery)
+{
+    static const char kCRLF[] = "\r\n";
+    static const char kHeaderEnd[] = "\r\n\r\n";
+    std::string crlfText = makeText(size, kCRLF, crEvery);
+    std::string lfText = makeText(size, "\n", crEvery);
+    std::string headerText = makeText(size, kHeaderEnd, crEvery);
+
+    printf("--- %luKB buffer%s (GB/s) ---\n", size >> 10, crEvery ? " dense \\r" : "");
+    printf("%-10s CRLF %6.2f  EOL %6.2f  \\r\\n\\r\\n %6.2f\n", "std",
+           measure(crlfText, totalBytes, [](const char *b, const char *e) { return std::search(b, e, kCRLF, kCRLF + 2); }),
+           measure(lfText, totalBytes, [](const char *b, const char *e) { return std::find(b, e, '\n'); }),
+           measure(headerText, totalBytes, [](const char *b, const char *e) { return std::search(b, e, kHeaderEnd, kHeaderEnd + 4); }));
+    printf("%-10s CRLF %6.2f  EOL %6.2f  \\r\\n\\r\\n %6.2f\n", "libc",
+           measure(crlfText, totalBytes, [](const char *b, const char *e) {
+               return static_cast<const char *>(::memmem(b, e - b, kCRLF, 2)); }),
+           measure(lfText, totalBytes, [](const char *b, const char *e) {
+               return static_cast<const char *>(::memchr(b, '\n', e - b)); }),
+           measure(headerText, totalBytes, [](const char *b, const char *e) {
+               return static_cast<const char *>(::memmem(b, e - b, kHeaderEnd, 4)); }));
+
+    const ByteSearch::Level levels[] = {ByteSearch::kScalar, ByteSearch::kSse2, ByteSearch::kAvx2};
+    for (ByteSearch::Level level : levels)
+    {
+        if (ByteSearch::setLevel(level) != level)
+        {
+            continue; // CPU不支持
+        }
+        printf("%-10s CRLF %6.2f  EOL %6.2f  \\r\\n\\r\\n %6.2f\n", ByteSearch::levelName(level),
+               measure(crlfText, totalBytes, [](const char *b, const char *e) { return ByteSearch::findPair(b, e, '\r', '\n'); }),
+               measure(lfText, totalBytes, [](const char *b, const char *e) { return ByteSearch::findByte(b, e, '\n'); }),
+               measure(headerText, totalBytes, [](const char *b, const char *e) { return ByteSearch::findSeq(b, e, kHeaderEnd, 4); }));
+    }
+}
+
+// 头部分多次到达 每次到达后查找\r\n\r\n 返回累计扫描的字节数
+static size_t scanIncrementally(const std::string &header, size_t chunk, bool resume)
+{
+    Buffer buf;
+    size_t scanned = 0;
+    size_t offset = 0;
+    for (size_t pos = 0; pos < header.size(); pos += chunk)
+    {
+        buf.append(header.data() + pos, std::min(chunk, header.size() - pos));
+        size_t from = resume ? offset : 0;
+        const char *hit = buf.findSeq("\r\n\r\n", 4, &offset);
+        scanned += (hit ? hit - buf.peek() + 4 : buf.readableBytes()) - from;
+        if (hit)
+        {
+            break;
+        }
+        if (!resume)
+        {
+            offset = 0;
+        }
+    }
+    return scanned;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t totalBytes = (argc > 1 ? atol(argv[1]) : 2048) * 1024 * 1024;
+    ByteSearch::Level best = ByteSearch::level();
+    printf("runtime selection: %s\n", ByteSearch::levelName(best));
+
+    const size_t sizes[] = {1024, 4 * 1024, 16 * 1024, 64 * 1024};
+    for (size_t size : sizes)
+    {
+        benchSize(size, totalBytes, 0);
+    }
+    benchSize(16 * 1024, totalBytes, 32);
+    ByteSearch::setLevel(best);
+
+    std::string header = makeText(8 * 1024, "\r\n\r\n");
+    size_t full = scanIncrementally(header, 64, false);
+    size_t incremental = scanIncrementally(header, 64, true);
+    printf("--- 8KB header arriving in 64B reads ---\n");
+    printf("rescan from start: %lu bytes scanned\n", full);
+    printf("resumable search : %lu bytes scanned (%.1fx less)\n", incremental, static_cast<double>(full) / incremental);
+    return 0;
+}
@@ -0,0 +1,151 @@
+/**
+ * 每条echo消息的堆分配压测: 替换全局operator new计数 只统计连接全部建立之后的ping-pong阶段
+ * loop  : onMessage中直接send 不经过pendingFunctors_
+ * worker: onMessage把消息交给另一个loop(模拟业务线程) 由它调用send再回到连接所在的loop
+ *         每条消息经过两次跨线程的queueInLoop 捕获shared_ptr<TcpConnection>加参数
+ * 日志本身也在分配内存: 服务端日志重定向到临时文件 按行数和每行的分配次数扣除 单独列出
+ *
+ * 用法: ./task_alloc_bench [连接数=16] [每个连接的往返次数=2000] [消息字节数=64]
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TcpServer.h"
+#include "EventLoopThread.h"
+#include "Logger.h"
+#include "alloc_counter.h"
+
+static bool readFull(int fd, char *buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len)
+    {
+        ssize_t n = ::read(fd, buf + got, len - got);
+        if (n <= 0)
+        {
+            return false;
+        }
+        got += n;
+    }
+    return true;
+}
+
+// 在客户端线程中运行 所有连接同时发一条消息 再依次读回 重复rounds次
+static AllocCount pingPong(uint16_t port, int conns, int rounds, size_t msgSize, FILE *logFile)
+{
+    InetAddress addr(port);
+    std::vector<int> fds;
+    for (int i = 0; i < conns; ++i)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (::connect(fd, (const sockaddr *)addr.getSockAddr(), sizeof(sockaddr_in)) < 0)
+        {
+            perror("connect");
+            exit(1);
+        }
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+        fds.push_back(fd);
+    }
+    std::string msg(msgSize, 'x');
+    std::vector<char> reply(msgSize);
+
+    // 第一轮预热 服务端建立连接、分配Buffer存储等都在这里完成
+    for (int fd : fds)
+    {
+        ::write(fd, msg.data(), msg.size());
+    }
+    for (int fd : fds)
+    {
+        readFull(fd, reply.data(), reply.size());
+    }
+
+    AllocCount before = allocCount(logFile);
+    for (int r = 0; r < rounds; ++r)
+    {
+        for (int fd : fds)
+        {
+            ::write(fd, msg.data(), msg.size());
+        }
+        for (int fd : fds)
+        {
+            if (!readFull(fd, reply.data(), reply.size()))
+            {
+                fprintf(stderr, "connection closed\n");
+                exit(1);
+            }
+        }
+    }
+    AllocCount result = allocCount(logFile) - before;
+    for (int fd : fds)
+    {
+        ::close(fd);
+    }
+    return result;
+}
+
+static void runRound(const char *mode, uint16_t port, int conns, int rounds, size_t msgSize,
+                     FILE *logFile, double allocsPerLine)
+{
+    bool viaWorker = strcmp(mode, "worker") == 0;
+    AllocCount result;
+    {
+        EventLoop loop;
+        EventLoopThread workerThread;
+        EventLoop *worker = workerThread.startLoop();
+        TcpServer server(&loop, InetAddress(port), "TaskAllocBench");
+        server.setThreadNum(1);
+        server.setConnectionCallback([](const TcpConnectionPtr &) {});
+        server.setMessageCallback([viaWorker, worker, msgSize](const TcpConnectionPtr &conn, Buffer *buf, Timestamp) {
+            if (!viaWorker)
+            {
+                conn->send(buf);
+                return;
+            }
+            while (buf->readableBytes() >= msgSize)
+            {
+                std::string msg = buf->retrieveAsString(msgSize);
+                worker->queueInLoop([conn, msg]() mutable { conn->send(std::move(msg)); });
+            }
+        });
+        server.start();
+
+        std::thread client([&]() {
+            ::usleep(100 * 1000); // 等待开始监听
+            result = pingPong(port, conns, rounds, msgSize, logFile);
+            ::usleep(100 * 1000); // 等待服务端处理完断开
+            loop.quit();
+        });
+        loop.loop();
+        client.join();
+    }
+
+    AllocSplit split = splitAllocs(result, static_cast<double>(rounds) * conns, allocsPerLine);
+    fprintf(stderr, "%-6s: %6.2f allocs/message (logging %5.2f, library %5.2f)\n",
+            mode, split.total, split.logging, split.library);
+}
+
+int main(int argc, char *argv[])
+{
+    int conns = argc > 1 ? atoi(argv[1]) : 16;
+    int rounds = argc > 2 ? atoi(argv[2]) : 2000;
+    size_t msgSize = argc > 3 ? atoi(argv[3]) : 64;
+
+    FILE *logFile = redirectLogToTempFile();
+    double allocsPerLine = measureAllocsPerLogLine(logFile, [](int i) {
+        LOG_INFO("channel handleEvent revents:%d\n", i);
+    });
+
+    fprintf(stderr, "connections=%d rounds=%d msgSize=%lu sizeof(Functor)=%lu logging=%.1f allocs/line\n",
+            conns, rounds, msgSize, sizeof(EventLoop::Functor), allocsPerLine);
+    runRound("loop", 9241, conns, rounds, msgSize, logFile, allocsPerLine);
+    runRound("worker", 9242, conns, rounds, msgSize, logFile, allocsPerLine);
+    return 0;
+}
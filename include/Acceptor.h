@@ -5,9 +5,9 @@
 #include "noncopyable.h"
 #include "Socket.h"
 #include "Channel.h"
+#include "InetAddress.h"
 
 class EventLoop;
-class InetAddress;
 
 class Acceptor : noncopyable
 {
@@ -22,13 +22,25 @@ public:
     bool listenning() const { return listenning_; }
     // 监听本地端口
     void listen();
+    // 每次可读事件最多accept的连接数 积压的连接一次取完 减少epoll_wait的次数
+    void setAcceptBatch(int batch) { acceptBatch_ = batch > 0 ? batch : 1; }
+    // 监听地址是具体的ip(不是INADDR_ANY)时 新连接的本端地址就是监听地址 不需要再getsockname
+    bool localAddrKnown() const { return localAddrKnown_; }
+    const InetAddress &localAddr() const { return localAddr_; }
+
+    static const int kDefaultAcceptBatch = 64;
 
 private:
     void handleRead();//处理新用户的连接事件
+    void shedConnection();//fd用完时 借用预留的fd接受一个连接并立即关闭
 
     EventLoop *loop_; // Acceptor用的就是用户定 义的那个baseLoop 也称作mainLoop
     Socket acceptSocket_;//专门用于接收新连接的socket
     Channel acceptChannel_;//专门用于监听新连接的channel
     NewConnectionCallback NewConnectionCallback_;//新连接的回调函数
     bool listenning_;//是否在监听
+    int acceptBatch_;//每次可读事件最多accept的连接数
+    int idleFd_;//预留的空闲fd(/dev/null) 遇到EMFILE时释放出来用于丢弃连接
+    InetAddress localAddr_;//实际绑定的地址(端口为0时是内核分配的端口)
+    bool localAddrKnown_;//localAddr_能否直接作为新连接的本端地址
 };
\ No newline at end of file
@@ -1,9 +1,20 @@
 #pragma once
 
 #include <vector>
+#include <deque>
+#include <memory>
 #include <string>
 #include <algorithm>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+#include <sys/types.h>
+
+#include "BufferPool.h"
+#include "Slice.h"
+
+class ReceiveArena;
 
 // 网络库底层的缓冲区类型定义
 class Buffer
@@ -11,28 +22,86 @@ class Buffer
 public:
     static const size_t kCheapPrepend = 8;//初始预留的prependabel空间大小
     static const size_t kInitialSize = 1024; // 
+    static const size_t kBlockSize = 16 * 1024; // 链式模式下每个块的大小
+    static const size_t kMinReferenceBytes = 1024; // 链式模式下不小于这个大小的Slice按引用追加 更小的直接拷贝
 
     explicit Buffer(size_t initalSize = kInitialSize)
-        : buffer_(kCheapPrepend + initalSize)
+        : buffer_(PoolAllocator<char>().allocate(kCheapPrepend + initalSize))
+        , capacity_(kCheapPrepend + initalSize)
         , readerIndex_(kCheapPrepend)
         , writerIndex_(kCheapPrepend)
+        , pool_(nullptr)
+        , chained_(false)
+        , chainedBytes_(0)
+    {
+    }
+
+    /**
+     * 存储从pool(所属loop的BufferPool)分配 构造时不分配 第一次写入时才在loop线程中分配
+     * 数据全部取走(retrieveAll)后立即把存储还给pool 空闲连接不占用缓冲区内存
+     **/
+    explicit Buffer(BufferPool *pool)
+        : buffer_(nullptr)
+        , capacity_(0)
+        , readerIndex_(0)
+        , writerIndex_(0)
+        , pool_(pool)
+        , chained_(false)
+        , chainedBytes_(0)
     {
     }
+    ~Buffer() { releaseStorage(); }
+    // 存储由Buffer自己管理 不可拷贝
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
+
+    /**
+     * 链式模式: 数据存放在一串固定大小的块中 追加数据只会申请新块 不会搬移或realloc已有的数据
+     * writeFd用writev一次发送最多IOV_MAX个块 适合给慢速对端排队大量数据的outputBuffer_
+     * peek()要求可读数据连续 跨块时会合并到一个块中(只在应用peek时发生)
+     **/
+    void setChained(bool on);
+    bool isChained() const { return chained_; }
 
     // 可读数据长度
-    size_t readableBytes() const { return writerIndex_ - readerIndex_; }
-    // 可写空间长度
-    size_t writableBytes() const { return buffer_.size() - writerIndex_; }
+    size_t readableBytes() const { return chained_ ? chainedBytes_ : writerIndex_ - readerIndex_; }
+    // 可写空间长度 链式模式下是最后一个块的剩余空间
+    size_t writableBytes() const
+    {
+        if (chained_)
+        {
+            return blocks_->empty() ? 0 : blocks_->back().writableBytes();
+        }
+        return capacity_ - writerIndex_;
+    }
     //前置预留空间长度
-    size_t prependableBytes() const { return readerIndex_; }
+    size_t prependableBytes() const
+    {
+        if (chained_)
+        {
+            return blocks_->empty() ? kCheapPrepend : blocks_->front().readerIndex;
+        }
+        return readerIndex_;
+    }
 
     // 返回缓冲区中可读数据的起始地址
-    const char *peek() const { return begin() + readerIndex_; }
+    const char *peek() const
+    {
+        if (chained_)
+        {
+            return chainPeek();
+        }
+        return begin() + readerIndex_;
+    }
 
     // 读取指定长度数据
     void retrieve(size_t len)
     {
-        if (len < readableBytes())
+        if (chained_)
+        {
+            chainRetrieve(len);
+        }
+        else if (len < readableBytes())
         {
             readerIndex_ += len; // 说明应用只读取了可读缓冲区数据的一部分，就是len长度 还剩下readerIndex+=len到writerIndex_的数据未读
         }
@@ -44,6 +113,17 @@ public:
     // 读完所有数据，复位缓冲区
     void retrieveAll()
     {
+        if (chained_)
+        {
+            blocks_->clear();
+            chainedBytes_ = 0;
+            return;
+        }
+        if (pool_ || capacity_ == 0)
+        {
+            releaseStorage(); // 还给pool 下次写入时再分配
+            return;
+        }
         readerIndex_ = kCheapPrepend;
         writerIndex_ = kCheapPrepend;
     }
@@ -54,49 +134,167 @@ public:
     // 读取数据并转为字符串
     std::string retrieveAsString(size_t len)
     {
+        if (chained_)
+        {
+            return chainRetrieveAsString(len); // 逐块拷贝 不需要先合并
+        }
         std::string result(peek(), len);
         retrieve(len); // 上面一句把缓冲区中可读的数据已经读取出来 这里肯定要对缓冲区进行复位操作
         return result;
     }
 
-    // buffer_.size - writerIndex_
+    // capacity_ - writerIndex_
     void ensureWritableBytes(size_t len)
     {
         if (writableBytes() < len)
         {
-            makeSpace(len); // 扩容
+            if (chained_)
+            {
+                pushBlock(len); // 追加一个新块 已有数据不动
+            }
+            else
+            {
+                makeSpace(len); // 扩容
+            }
         }
     }
 
     // 把[data, data+len]内存上的数据添加到writable缓冲区当中
     void append(const char *data, size_t len)
     {
+        if (chained_)
+        {
+            chainAppend(data, len);
+            return;
+        }
         ensureWritableBytes(len);
         std::copy(data, data+len, beginWrite());
         writerIndex_ += len;
     }
-    char *beginWrite() { return begin() + writerIndex_; }
-    const char *beginWrite() const { return begin() + writerIndex_; }
+    // 追加一个Slice 链式模式下较大的Slice只保存引用(不拷贝) 线性模式下或者Slice没有持有者时拷贝
+    void append(const Slice &slice);
+    // 把other的可读数据全部移到本Buffer末尾并清空other 两者都是链式模式时整块移动 不拷贝
+    void append(Buffer *other);
+    // 链式模式下第一个块引用Slice时 返回它还没被取走的部分(共享同一个持有者) 否则返回空Slice
+    Slice frontReference() const;
+
+    /**
+     * 把数据写到可读数据的前面 优先使用预留的prependable空间(kCheapPrepend) 不搬移已有数据
+     * 先组好消息正文 再在前面补上长度等头部 发送时头部和正文是连续的
+     * 预留空间不够时: 线性模式重新分配并搬移一次 链式模式在链头加一个小块
+     **/
+    void prepend(const void *data, size_t len);
+
+    // 网络字节序(大端)的整数读写 peek不取走数据 read取走 需要readableBytes()足够
+    void appendInt64(int64_t x) { uint64_t be = htobe64(x); append(reinterpret_cast<const char *>(&be), sizeof be); }
+    void appendInt32(int32_t x) { uint32_t be = htobe32(x); append(reinterpret_cast<const char *>(&be), sizeof be); }
+    void appendInt16(int16_t x) { uint16_t be = htobe16(x); append(reinterpret_cast<const char *>(&be), sizeof be); }
+    void appendInt8(int8_t x) { append(reinterpret_cast<const char *>(&x), sizeof x); }
+    void prependInt64(int64_t x) { uint64_t be = htobe64(x); prepend(&be, sizeof be); }
+    void prependInt32(int32_t x) { uint32_t be = htobe32(x); prepend(&be, sizeof be); }
+    void prependInt16(int16_t x) { uint16_t be = htobe16(x); prepend(&be, sizeof be); }
+    void prependInt8(int8_t x) { prepend(&x, sizeof x); }
+    int64_t peekInt64() const { uint64_t be; ::memcpy(&be, peekBytes(sizeof be), sizeof be); return be64toh(be); }
+    int32_t peekInt32() const { uint32_t be; ::memcpy(&be, peekBytes(sizeof be), sizeof be); return be32toh(be); }
+    int16_t peekInt16() const { uint16_t be; ::memcpy(&be, peekBytes(sizeof be), sizeof be); return be16toh(be); }
+    int8_t peekInt8() const { return *peekBytes(1); }
+    int64_t readInt64() { int64_t x = peekInt64(); retrieve(sizeof x); return x; }
+    int32_t readInt32() { int32_t x = peekInt32(); retrieve(sizeof x); return x; }
+    int16_t readInt16() { int16_t x = peekInt16(); retrieve(sizeof x); return x; }
+    int8_t readInt8() { int8_t x = peekInt8(); retrieve(sizeof x); return x; }
+
+    char *beginWrite() { return chained_ ? blocks_->back().beginWrite() : begin() + writerIndex_; }
+    const char *beginWrite() const { return chained_ ? blocks_->back().beginWrite() : begin() + writerIndex_; }
+    // 直接写入beginWrite()之后 提交写入的len字节
+    void hasWritten(size_t len)
+    {
+        if (chained_)
+        {
+            blocks_->back().writerIndex += len;
+            chainedBytes_ += len;
+        }
+        else
+        {
+            writerIndex_ += len;
+        }
+    }
+
+    /**
+     * 在可读数据中查找分隔符 返回第一个匹配的位置 没找到返回nullptr 使用ByteSearch的向量化实现
+     * start版本从start(在[peek(), peek()+readableBytes()]之间)开始找
+     * resume版本从peek()+*resume开始找 返回前把*resume更新为下次应该开始的偏移:
+     * 没找到时跳过已经确认不可能匹配的部分 数据没收全时下次只扫描新到的数据 retrieve之后要把*resume清零
+     * 链式模式下会先把数据合并成连续的(见peek)
+     **/
+    const char *findCRLF() const { return findCRLF(peek()); }
+    const char *findCRLF(const char *start) const;
+    const char *findCRLF(size_t *resume) const;
+    const char *findEOL() const { return findEOL(peek()); }
+    const char *findEOL(const char *start) const { return findByte(start, '\n'); }
+    const char *findEOL(size_t *resume) const { return findByte('\n', resume); }
+    const char *findByte(char c) const { return findByte(peek(), c); }
+    const char *findByte(const char *start, char c) const;
+    const char *findByte(char c, size_t *resume) const;
+    const char *findSeq(const char *needle, size_t len) const { return findSeq(peek(), needle, len); }
+    const char *findSeq(const char *start, const char *needle, size_t len) const;
+    const char *findSeq(const char *needle, size_t len, size_t *resume) const;
 
     // 从fd上读取数据
     ssize_t readFd(int fd, int *saveErrno);
+    // 从fd上读取数据 放不下的部分先读到loop共享的接收区 链式模式下接收区的存储直接挂到链尾 见ReceiveArena
+    ssize_t readFd(int fd, int *saveErrno, ReceiveArena *arena);
     // 通过fd发送数据
     ssize_t writeFd(int fd, int *saveErrno);
 
 private:
-    // vector底层数组首元素的地址 也就是数组的起始地址
-    char *begin() { return &*buffer_.begin(); }
-    const char *begin() const { return &*buffer_.begin(); }
+    // 底层数组的起始地址 存储已释放时为空
+    char *begin() { return buffer_; }
+    const char *begin() const { return buffer_; }
+
+    // 释放线性存储 此时readerIndex_ = writerIndex_ = 0 下次makeSpace重新分配
+    void releaseStorage()
+    {
+        if (buffer_)
+        {
+            PoolAllocator<char>(pool_).deallocate(buffer_, capacity_);
+        }
+        buffer_ = nullptr;
+        capacity_ = 0;
+        readerIndex_ = 0;
+        writerIndex_ = 0;
+    }
+
+    // 扩容到至少capacity字节 至少翻倍 保证追加的均摊复杂度 只拷贝可读数据
+    void grow(size_t capacity)
+    {
+        capacity = std::max(capacity, capacity_ * 2);
+        char *storage = PoolAllocator<char>(pool_).allocate(capacity);
+        ::memcpy(storage + readerIndex_, begin() + readerIndex_, readableBytes());
+        if (buffer_)
+        {
+            PoolAllocator<char>(pool_).deallocate(buffer_, capacity_);
+        }
+        buffer_ = storage;
+        capacity_ = capacity;
+    }
 
     void makeSpace(size_t len)
     {
+        if (capacity_ == 0) // 存储已释放 重新分配
+        {
+            buffer_ = PoolAllocator<char>(pool_).allocate(kCheapPrepend + std::max(len, kInitialSize));
+            capacity_ = kCheapPrepend + std::max(len, kInitialSize);
+            readerIndex_ = kCheapPrepend;
+            writerIndex_ = kCheapPrepend;
+            return;
+        }
         /**
          * | kCheapPrepend |xxx| reader | writer |                     // xxx标示reader中已读的部分
          * | kCheapPrepend | reader ｜          len          |
          **/
         if (writableBytes() + prependableBytes() < len + kCheapPrepend) // 也就是说 len > xxx前面剩余的空间 + writer的部分
         {
-            buffer_.resize(writerIndex_ + len);
+            grow(writerIndex_ + len);
         }
         else // 这里说明 len <= xxx + writer 把reader搬到从xxx开始 使得xxx后面是一段连续空间
         {
@@ -111,7 +309,95 @@ private:
         }
     }
 
-    std::vector<char> buffer_;
+    // 链式模式下的一个块
+    struct Block
+    {
+        Block(size_t cap, BufferPool *pool)
+            : data(PoolAllocator<char>(pool).allocate(cap))
+            , capacity(cap)
+            , readerIndex(0)
+            , writerIndex(0)
+            , pool(pool)
+        {
+        }
+        // 接管已经写入len字节的data 由pool归还
+        Block(char *data, size_t cap, size_t len, BufferPool *pool)
+            : data(data)
+            , capacity(cap)
+            , readerIndex(0)
+            , writerIndex(len)
+            , pool(pool)
+        {
+        }
+        // 引用slice的数据 不分配也不拷贝 只读(没有可写空间)
+        explicit Block(const Slice &slice)
+            : data(const_cast<char *>(slice.data()))
+            , capacity(slice.size())
+            , readerIndex(0)
+            , writerIndex(slice.size())
+            , pool(nullptr)
+            , holder(slice.holder())
+        {
+        }
+        Block(Block &&other)
+            : data(other.data)
+            , capacity(other.capacity)
+            , readerIndex(other.readerIndex)
+            , writerIndex(other.writerIndex)
+            , pool(other.pool)
+            , holder(std::move(other.holder))
+        {
+            other.data = nullptr;
+        }
+        ~Block()
+        {
+            if (data && !holder)
+            {
+                PoolAllocator<char>(pool).deallocate(data, capacity);
+            }
+        }
+        Block(const Block &) = delete;
+        Block &operator=(const Block &) = delete;
+        Block &operator=(Block &&) = delete;
+
+        size_t readableBytes() const { return writerIndex - readerIndex; }
+        size_t writableBytes() const { return capacity - writerIndex; }
+        char *peek() const { return data + readerIndex; }
+        char *beginWrite() const { return data + writerIndex; }
+
+        char *data;
+        size_t capacity;
+        size_t readerIndex;
+        size_t writerIndex;
+        BufferPool *pool;
+        std::shared_ptr<const void> holder; // 引用Slice时持有数据 data不归本块所有
+    };
+
+    void pushBlock(size_t minWritable);
+    void chainAppend(const char *data, size_t len);
+    void chainRetrieve(size_t len);
+    std::string chainRetrieveAsString(size_t len);
+    const char *chainPeek() const;
+    ssize_t chainWriteFd(int fd, int *saveErrno);
+    // 可读数据的前len个字节 链式模式下第一个块就够时不合并
+    const char *peekBytes(size_t len) const
+    {
+        return chained_ && !blocks_->empty() && blocks_->front().readableBytes() >= len ? blocks_->front().peek() : peek();
+    }
+    void chainPrepend(const void *data, size_t len);
+    // 从*resume开始查找长度为len的模式 见findCRLF(size_t *)
+    template <typename Finder>
+    const char *findResumable(size_t len, size_t *resume, Finder find) const;
+
+    char *buffer_;
+    size_t capacity_;
     size_t readerIndex_;
     size_t writerIndex_;
+    BufferPool *pool_; // 存储来源 为空时走operator new
+
+    bool chained_;                    // 是否为链式模式
+    // 链式模式下的数据块 除最后一个块外都有可读数据 peek()合并跨块数据时会修改
+    // 第一次切换到链式模式时才创建 std::deque默认构造就要分配两次 线性模式的Buffer用不到
+    mutable std::unique_ptr<std::deque<Block>> blocks_;
+    size_t chainedBytes_;             // 链式模式下所有块的可读字节数
 };
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "noncopyable.h"
+
+class EventLoop;
+
+/**
+ * Buffer存储用的内存池 每个EventLoop一个 只在所属loop线程中访问 不加锁
+ *
+ * 按大小分级(size class) 每级一个空闲链表 申请时向上取整到所在级别:
+ *   1. 对应级别有空闲块 => 命中 直接复用
+ *   2. 没有空闲块/超过最大级别 => 未命中 走operator new
+ * 归还时放回空闲链表 缓存总量超过maxCachedBytes或者超过最大级别时直接释放
+ * 其他线程中分配/归还(如TcpConnection在别的线程析构)直接走operator new/delete 不碰空闲链表
+ * 每隔kTrimInterval秒把这段时间内一直没有被用到的空闲块还给系统
+ **/
+class BufferPool : noncopyable
+{
+public:
+    // 计数 其他线程可以无锁读取
+    struct Stats
+    {
+        int64_t hits;        // 从空闲链表分配的次数
+        int64_t misses;      // 走operator new分配的次数
+        int64_t cachedBytes; // 空闲链表中缓存的字节数
+        int64_t inUseBytes;  // 已分配还未归还的字节数(按级别取整)
+    };
+
+    explicit BufferPool(EventLoop *loop);
+    ~BufferPool();
+
+    void *allocate(size_t size);
+    void deallocate(void *p, size_t size);
+
+    // 每个loop空闲链表最多缓存的字节数 需在loop线程中调用
+    void setMaxCachedBytes(size_t bytes) { maxCachedBytes_ = bytes; }
+    // 线程安全
+    Stats stats() const;
+
+    static const size_t kDefaultMaxCachedBytes = 8 * 1024 * 1024;
+    static const double kTrimInterval; // 空闲块回收周期(秒)
+
+private:
+    struct SizeClass
+    {
+        size_t size;               // 这一级的块大小
+        std::vector<void *> free;  // 空闲块
+        size_t lowWater;           // 本周期内空闲链表的最小长度 这些块整个周期都没被用到
+    };
+
+    // 返回size所在的级别 超过最大级别返回-1
+    int sizeClass(size_t size) const;
+    void trim();
+
+    // 单写者 用load+store代替fetch_add
+    static void addRelaxed(std::atomic<int64_t> &counter, int64_t delta)
+    { counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed); }
+
+    EventLoop *loop_;
+    std::vector<SizeClass> classes_;
+    size_t maxCachedBytes_;
+    bool trimming_; // 回收定时器是否已经启动 第一次分配时才启动 没有连接的loop不会被定时唤醒
+
+    std::atomic<int64_t> hits_;
+    std::atomic<int64_t> misses_;
+    std::atomic<int64_t> cachedBytes_;
+    std::atomic<int64_t> inUseBytes_;
+    std::atomic<int64_t> foreignBytes_; // 其他线程分配(正)/归还(负)的字节数 多写者 用fetch_add
+};
+
+/**
+ * 从BufferPool分配/归还内存 pool为空时走operator new/delete
+ **/
+template <typename T>
+class PoolAllocator
+{
+public:
+    explicit PoolAllocator(BufferPool *pool = nullptr) : pool_(pool) {}
+
+    T *allocate(size_t n)
+    {
+        size_t bytes = n * sizeof(T);
+        return static_cast<T *>(pool_ ? pool_->allocate(bytes) : ::operator new(bytes));
+    }
+    void deallocate(T *p, size_t n)
+    {
+        if (pool_)
+        {
+            pool_->deallocate(p, n * sizeof(T));
+        }
+        else
+        {
+            ::operator delete(p);
+        }
+    }
+
+private:
+    BufferPool *pool_;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * Buffer查找分隔符用的字节查找 x86上按CPUID在运行时选择AVX2/SSE2实现 其他平台用标量实现
+ * 每次比较16/32个字节 命中后用位掩码定位 多字节序列先用首尾两个字节过滤候选位置再逐个比较
+ * 所有函数在[begin, end)中查找 没找到返回nullptr
+ **/
+namespace ByteSearch {
+    enum Level
+    {
+        kScalar, // memchr/memmem
+        kSse2,
+        kAvx2,
+    };
+
+    // 第一个字节c
+    const char *findByte(const char *begin, const char *end, char c);
+    // 第一个相邻的c0c1 如\r\n
+    const char *findPair(const char *begin, const char *end, char c0, char c1);
+    // 第一个needle[0, len) len为0时返回begin
+    const char *findSeq(const char *begin, const char *end, const char *needle, size_t len);
+
+    // 当前使用的实现
+    Level level();
+    const char *levelName(Level level);
+    // 强制使用某个实现(不超过CPU支持的级别) 返回实际使用的级别 用于测试和压测 需在其他线程开始查找之前调用
+    Level setLevel(Level level);
+}
@@ -12,6 +12,10 @@ using ConnectionCallback = std::function<void(const TcpConnectionPtr &)>;
 using CloseCallback = std::function<void(const TcpConnectionPtr &)>;
 using WriteCompleteCallback = std::function<void(const TcpConnectionPtr &)>;
 using HighWaterMarkCallback = std::function<void(const TcpConnectionPtr &, size_t)>;
+using LowWaterMarkCallback = std::function<void(const TcpConnectionPtr &, size_t)>;
+using ReadStateCallback = std::function<void(const TcpConnectionPtr &, bool)>;
+using ZeroCopyCompleteCallback = std::function<void(const TcpConnectionPtr &)>;
+using TimerCallback = std::function<void()>;
 
 using MessageCallback = std::function<void(const TcpConnectionPtr &,
                                            Buffer *,
@@ -5,6 +5,7 @@
 
 #include "noncopyable.h"
 #include "Timestamp.h"
+#include "InlineFunction.h"
 
 class EventLoop;
 
@@ -17,9 +18,10 @@ class Channel : noncopyable  // 继承noncopyable，禁止拷贝Channel对象
 public:
     // 定义回调函数类型：
     // EventCallback 是无参无返回的函数对象，用于处理写、关闭、错误事件
-    using EventCallback = std::function<void()>; 
+    // 只能移动 bind(成员函数, this)这类回调存放在内联存储中 调用时不经过std::function的间接跳转和堆上的对象
+    using EventCallback = InlineFunction<void()>;
     // ReadEventCallback 是带Timestamp参数的函数对象，用于处理读事件（时间戳记录事件发生时间）
-    using ReadEventCallback = std::function<void(Timestamp)>;
+    using ReadEventCallback = InlineFunction<void(Timestamp)>;
 
     // 构造函数：初始化所属的EventLoop、文件描述符fd
     Channel(EventLoop *loop, int fd);
@@ -39,14 +41,17 @@ public:
 
     // 以下是获取成员变量的内联函数：
     int fd() const { return fd_; }         // 获取封装的文件描述符
-    int events() const { return events_; } // 获取感兴趣的事件集合
+    // 获取注册到Poller的事件集合 ET模式下EPOLLOUT只注册一次 是否真正关注写事件由events_记录
+    int events() const
+    { return edgeTriggered_ && events_ != kNoneEvent ? events_ | kWriteEvent | kEdgeTriggered : events_; }
     void set_revents(int revt) { revents_ = revt; } // 设置实际发生的事件（由Poller调用）
 
     // 以下方法用于修改感兴趣的事件，并通知EventLoop更新Poller的监控
     void enableReading() { events_ |= kReadEvent; update(); }  // 启用读事件
     void disableReading() { events_ &= ~kReadEvent; update(); } // 禁用读事件
-    void enableWriting() { events_ |= kWriteEvent; update(); }  // 启用写事件
-    void disableWriting() { events_ &= ~kWriteEvent; update(); } // 禁用写事件
+    // ET模式下EPOLLOUT一直在Poller中 切换写事件不需要epoll_ctl 除非从无事件变为有事件(或相反)
+    void enableWriting() { bool wasNone = isNoneEvent(); events_ |= kWriteEvent; if (!edgeTriggered_ || wasNone) update(); }  // 启用写事件
+    void disableWriting() { events_ &= ~kWriteEvent; if (!edgeTriggered_ || isNoneEvent()) update(); } // 禁用写事件
     void disableAll() { events_ = kNoneEvent; update(); }       // 禁用所有事件
 
     // 判断当前感兴趣的事件状态
@@ -54,6 +59,10 @@ public:
     bool isWriting() const { return events_ & kWriteEvent; }
     bool isReading() const { return events_ & kReadEvent; }
 
+    // 切换为边缘触发模式 需在第一次enableReading之前调用 只有EPOLL支持
+    void enableEdgeTriggered() { edgeTriggered_ = true; }
+    bool isEdgeTriggered() const { return edgeTriggered_; }
+
     int index() { return index_; }         // 获取在Poller中的索引（用于Poller内部管理）
     void set_index(int idx) { index_ = idx; } // 设置在Poller中的索引
 
@@ -68,12 +77,14 @@ private:
     static const int kNoneEvent;   // 无事件
     static const int kReadEvent;   // 读事件（EPOLLIN | EPOLLPRI）
     static const int kWriteEvent;  // 写事件（EPOLLOUT）
+    static const int kEdgeTriggered; // 边缘触发（EPOLLET）
 
     EventLoop *loop_;  // 所属的EventLoop，Channel的所有操作都在该loop的线程中执行
     const int fd_;     // 封装的文件描述符，const表示fd一旦初始化不可修改
     int events_;       // 感兴趣的事件（由用户设置，如读、写）
     int revents_;      // 实际发生的事件（由Poller填充）
     int index_;        // 在Poller中的索引，用于Poller高效管理事件
+    bool edgeTriggered_; // 是否为边缘触发模式
 
     std::weak_ptr<void> tie_;  // 临时保护生命周期
     bool tied_;                // 标记是否已绑定对象
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "noncopyable.h"
+
+/**
+ * TcpConnection对象的内存池 每个EventLoop一个 只在所属loop线程中访问 不加锁
+ *
+ * 所有块大小相同(kBlockSize) 正好放下allocate_shared的控制块和TcpConnection本身
+ * 连接的Socket、Channel都是TcpConnection的成员 一个连接的对象部分只占一个块
+ *   1. 有空闲块 => 命中 直接复用刚关闭的连接的块(缓存还热)
+ *   2. 没有空闲块 => 未命中 走operator new
+ * 归还时放回空闲链表 超过maxCached个时直接释放 不做定时回收 reserve预分配的块一直保留
+ * 其他线程中分配/归还直接走operator new/delete 不碰空闲链表
+ * 由EventLoop和分配器共同持有 loop析构时detach 之后归还的块(用户保存的TcpConnectionPtr最后释放)直接operator delete
+ **/
+class ConnectionPool : noncopyable
+{
+public:
+    // 计数 其他线程可以无锁读取
+    struct Stats
+    {
+        int64_t hits;   // 从空闲链表分配的次数
+        int64_t misses; // 走operator new分配的次数
+        int64_t cached; // 空闲链表中的块数
+        int64_t inUse;  // 已分配还未归还的块数
+    };
+
+    // threadId为所属loop的线程
+    explicit ConnectionPool(pid_t threadId);
+    ~ConnectionPool();
+
+    void *allocate(size_t size);
+    void deallocate(void *p, size_t size);
+
+    // 预先分配块放进空闲链表 直到空闲块不少于n个 连接风暴时不用再走malloc 需在loop线程中调用
+    void reserve(size_t n);
+    // 空闲链表最多缓存的块数 不小于reserve的个数 需在loop线程中调用
+    void setMaxCached(size_t n) { maxCached_ = n; }
+    // 线程安全
+    Stats stats() const;
+    // loop析构时在loop线程中调用 释放空闲链表 之后所有线程的分配/归还都直接走operator new/delete
+    void detach();
+
+    static const size_t kBlockSize;          // 控制块 + TcpConnection 按缓存行取整
+    static const size_t kDefaultMaxCached = 1024;
+
+private:
+    // 单写者 用load+store代替fetch_add
+    static void addRelaxed(std::atomic<int64_t> &counter, int64_t delta)
+    { counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed); }
+
+    // 在所属loop线程中 且loop还没有析构
+    bool inLoopThread() const;
+
+    const pid_t threadId_;
+    std::atomic_bool detached_;
+    std::vector<void *> free_; // 空闲块 后进先出
+    size_t maxCached_;
+
+    std::atomic<int64_t> hits_;
+    std::atomic<int64_t> misses_;
+    std::atomic<int64_t> cached_;
+    std::atomic<int64_t> inUse_;
+    std::atomic<int64_t> foreign_; // 其他线程分配(正)/归还(负)的块数 多写者 用fetch_add
+};
+
+/**
+ * std::allocate_shared用的分配器 控制块和对象一起从loop的ConnectionPool分配
+ * TcpConnectionPtr的用法不变 最后一个引用释放时块归还给pool
+ * 分配器保存在控制块中并持有pool的引用 连接比loop活得久时归还也不会访问已经释放的pool
+ **/
+template <typename T>
+class ConnectionAllocator
+{
+public:
+    using value_type = T;
+
+    explicit ConnectionAllocator(std::shared_ptr<ConnectionPool> pool) : pool_(std::move(pool)) {}
+    template <typename U>
+    ConnectionAllocator(const ConnectionAllocator<U> &other) : pool_(other.pool()) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(pool_->allocate(n * sizeof(T))); }
+    void deallocate(T *p, size_t n) { pool_->deallocate(p, n * sizeof(T)); }
+
+    const std::shared_ptr<ConnectionPool> &pool() const { return pool_; }
+
+private:
+    std::shared_ptr<ConnectionPool> pool_;
+};
+
+template <typename T, typename U>
+bool operator==(const ConnectionAllocator<T> &a, const ConnectionAllocator<U> &b) { return a.pool() == b.pool(); }
+template <typename T, typename U>
+bool operator!=(const ConnectionAllocator<T> &a, const ConnectionAllocator<U> &b) { return a.pool() != b.pool(); }
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <atomic>
+
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "TimerId.h"
+
+class Channel;
+class EventLoop;
+
+/**
+ * 主动发起连接 TcpClient使用
+ * 非阻塞connect之后把socket交给Channel关注可写事件 可写时用SO_ERROR判断连接是否成功 整个过程不阻塞loop
+ * 失败时关闭socket 按指数退避(初始retryDelayMs 每次翻倍 不超过maxRetryDelayMs)用loop的定时器重试
+ * 连接成功后把sockfd交给newConnectionCallback_ 之后sockfd由TcpConnection管理 Connector不再关心
+ **/
+class Connector : noncopyable, public std::enable_shared_from_this<Connector>
+{
+public:
+    using NewConnectionCallback = std::function<void(int sockfd)>;
+
+    Connector(EventLoop *loop, const InetAddress &serverAddr);
+    ~Connector();
+
+    void setNewConnectionCallback(const NewConnectionCallback &cb) { newConnectionCallback_ = cb; }
+    // 重试间隔 需在start()之前调用
+    void setRetryDelay(int initialMs, int maxMs) { initRetryDelayMs_ = retryDelayMs_ = initialMs; maxRetryDelayMs_ = maxMs; }
+
+    const InetAddress &serverAddress() const { return serverAddr_; }
+
+    void start();   // 线程安全
+    void restart(); // 只能在loop线程中调用 重置重试间隔后立即连接 用于连接断开后重连
+    void stop();    // 线程安全 取消正在进行的连接和等待中的重试
+
+    static const int kDefaultRetryDelayMs = 500;
+    static const int kDefaultMaxRetryDelayMs = 30 * 1000;
+
+private:
+    enum States
+    {
+        kDisconnected,
+        kConnecting,
+        kConnected
+    };
+
+    void setState(States s) { state_ = s; }
+    void startInLoop();
+    void stopInLoop();
+    void connect();
+    void connecting(int sockfd);
+    void handleWrite();
+    void handleError();
+    void retry(int sockfd);
+    int removeAndResetChannel();
+
+    EventLoop *loop_;
+    InetAddress serverAddr_;
+    std::atomic_bool connect_; // 用户是否要求连接 stop()之后不再重试
+    States state_;
+    std::unique_ptr<Channel> channel_; // 连接中的socket对应的Channel 只在kConnecting状态存在
+    NewConnectionCallback newConnectionCallback_;
+    int initRetryDelayMs_;
+    int maxRetryDelayMs_;
+    int retryDelayMs_; // 下一次重试的间隔
+    TimerId retryTimer_; // 等待中的重试 已经到期的定时器取消时没有副作用
+};
@@ -18,23 +18,41 @@ public:
  
     // 重写基类的抽象方法，实现 epoll_wait 逻辑，返回活跃事件的时间戳
     Timestamp poll(int timeoutMs, ChannelList* activeChannels) override;
-    // 重写基类方法，更新 Channel 在 epoll 中的事件监控状态
+    // 重写基类方法，记录 Channel 关注事件的变化 在下一次poll前统一提交
     void updateChannel(Channel *channel) override;
     // 重写基类方法，将 Channel 从 epoll 监控中移除
     void removeChannel(Channel *channel) override;
+    // epoll原生支持EPOLLET
+    bool edgeTriggeredSupported() const override { return true; }
+    // 通过EPIOCSPARAMS开启epoll忙轮询(Linux 6.9+)
+    bool setBusyPoll(int usec) override;
 
 private:
     // 定义 epoll_event 向量的初始容量，避免频繁扩容
     static const int kInitEventListSize = 16;
 
+    // 每个fd在epoll内核中的注册状态 下标为fd
+    struct FdState
+    {
+        int registered; // 内核中当前注册的事件 kNotRegistered表示不在epoll中
+        bool dirty;     // 本轮是否有未提交的修改 已在dirtyFds_中
+    };
+    static const int kNotRegistered = -1;
+
+    // 把本轮累积的修改在epoll_wait之前一次性提交 同一轮内来回切换的事件相互抵消 不产生系统调用
+    void flushUpdates();
+
     // 核心辅助方法：将 epoll_wait 返回的就绪事件填充到 activeChannels（传出参数）
     void fillActiveChannels(int numEvents, ChannelList *activeChannels) const;
     // 底层辅助方法：调用 epoll_ctl 执行 ADD/MOD/DEL 操作，更新 epoll 内部状态
-    void update(int operation, Channel *channel);
+    void update(int operation, Channel *channel, int events);
 
     // 类型别名：简化 epoll_event 向量的写法，提高代码可读性
     using EventList = std::vector<epoll_event>;
 
     int epollfd_; // epoll 实例的文件描述符（由 epoll_create 创建）
     EventList events_; // 存储 epoll_wait 返回的就绪事件列表
+
+    std::vector<FdState> fdStates_; // 下标为fd 与channels_一样是稠密数组
+    std::vector<int> dirtyFds_;     // 本轮有修改等待提交的fd
 };
\ No newline at end of file
@@ -4,20 +4,38 @@
 #include <vector>
 #include <atomic>
 #include <memory>
-#include <mutex>
  
 #include "noncopyable.h"
 #include "Timestamp.h"
 #include "CurrentThread.h"
+#include "Callbacks.h"
+#include "TimerId.h"
+#include "MpscQueue.h"
+#include "InlineFunction.h"
 
 class Channel;
 class Poller;
+class TimerQueue;
+class BufferPool;
+class ReceiveArena;
+class ConnectionPool;
+class ZeroCopyReaper;
 
 // 事件循环类 主要包含了两个大模块 Channel Poller(epoll的抽象)
 class EventLoop : noncopyable
 {
 public:
-    using Functor = std::function<void()>;
+    // 只能移动 常见的捕获(shared_ptr<TcpConnection>加参数)都存放在内联存储中 不需要堆分配
+    using Functor = InlineFunction<void()>;
+
+    // 忙轮询统计 单位微秒 只有开启忙轮询后才统计
+    struct BusyPollStats
+    {
+        int64_t spinMicros;  // 0超时poll空转(没有任何事件)的时间
+        int64_t workMicros;  // 处理事件和回调的时间
+        int64_t blockMicros; // 阻塞在poll中的时间
+        int64_t spinPolls;   // 空转的poll次数
+    };
 
     EventLoop();
     ~EventLoop();
@@ -29,11 +47,53 @@ public:
 
     Timestamp pollReturnTime() const { return pollRetureTime_; }
 
+    /**
+     * 开启自适应忙轮询 需在loop线程中或loop()之前调用
+     * spinMicros: 最近一次有事件之后 以0超时poll空转多久才退回阻塞poll <=0表示关闭
+     * socketBusyPollMicros: >0时同时开启epoll实例和新连接socket的内核忙轮询(SO_BUSY_POLL)
+     **/
+    void setBusyPoll(int spinMicros, int socketBusyPollMicros = 0);
+    int socketBusyPollMicros() const { return socketBusyPollMicros_; }
+
+    // 所属线程绑定的CPU和NUMA节点 没有绑定时为-1 由EventLoopThread在loop线程中设置
+    void setPlacement(int cpu, int numaNode) { cpu_ = cpu; numaNode_ = numaNode; }
+    int cpu() const { return cpu_; }
+    int numaNode() const { return numaNode_; }
+
+    // 负载计数 其他线程(如mainloop分发新连接时)可以无锁读取
+    // 连接数在分发时(mainloop)加、销毁时(本loop)减 所以用原子加 每个连接只有两次
+    void addConnections(int delta) { numConnections_.fetch_add(delta, std::memory_order_relaxed); }
+    // 待发送字节数只由本loop线程写
+    void addPendingBytes(int64_t delta) { addLoad(pendingBytes_, delta); }
+    int64_t numConnections() const { return numConnections_.load(std::memory_order_relaxed); }
+    int64_t pendingBytes() const { return pendingBytes_.load(std::memory_order_relaxed); }
+    // 线程安全
+    BusyPollStats busyPollStats() const;
+
+    // 本loop上连接的Buffer存储使用的内存池 只能在loop线程中分配/归还 stats()线程安全
+    BufferPool *bufferPool() const { return bufferPool_.get(); }
+    // 本loop上所有连接readFd共用的接收区 只能在loop线程中使用
+    ReceiveArena *receiveArena() const { return receiveArena_.get(); }
+    // 本loop上TcpConnection对象的内存池 在loop线程中分配/归还才走空闲链表 stats()线程安全
+    // 分配器持有它的引用 loop析构之后才释放的连接仍然可以安全归还
+    const std::shared_ptr<ConnectionPool> &connectionPool() const { return connectionPool_; }
+    // 已经销毁的连接还没完成的零拷贝发送 只能在loop线程中使用
+    ZeroCopyReaper *zeroCopyReaper() const { return zeroCopyReaper_.get(); }
+
     // 在当前loop中执行
     void runInLoop(Functor cb);
     // 把上层注册的回调函数cb放入队列中 唤醒loop所在的线程执行cb
     void queueInLoop(Functor cb);
 
+    // 在指定时间点执行cb 线程安全
+    TimerId runAt(Timestamp time, TimerCallback cb);
+    // 在delay秒之后执行cb 线程安全
+    TimerId runAfter(double delay, TimerCallback cb);
+    // 每隔interval秒执行一次cb 线程安全
+    TimerId runEvery(double interval, TimerCallback cb);
+    // 取消定时器 线程安全
+    void cancel(TimerId timerId);
+
     // 通过eventfd唤醒loop所在的线程
     void wakeup();
 
@@ -41,11 +101,16 @@ public:
     void updateChannel(Channel *channel);
     void removeChannel(Channel *channel);
     bool hasChannel(Channel *channel);
+    bool edgeTriggeredSupported() const;
 
     // 判断EventLoop对象是否在自己的线程里
     bool isInLoopThread() const { return threadId_ == CurrentThread::tid(); } // threadId_为EventLoop创建时的线程id CurrentThread::tid()为当前线程id
 
 private:
+    // 单写者 用load+store代替fetch_add 避免lock前缀指令
+    static void addLoad(std::atomic<int64_t> &counter, int64_t delta)
+    { counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed); }
+
     void handleRead();        // 给eventfd返回的文件描述符wakeupFd_绑定的事件回调 当wakeup()时 即有事件发生时 调用handleRead()读wakeupFd_的8字节 同时唤醒阻塞的epoll_wait
     void doPendingFunctors(); // 执行上层回调
 
@@ -58,13 +123,31 @@ private:
 
     Timestamp pollRetureTime_; // Poller返回发生事件的Channels的时间点
     std::unique_ptr<Poller> poller_;
+    std::unique_ptr<TimerQueue> timerQueue_; // 定时器队列 依赖poller_注册timerfd 必须在poller_之后构造
+    std::unique_ptr<BufferPool> bufferPool_; // 用timerQueue_定期回收空闲块 必须在timerQueue_之后构造
+    std::unique_ptr<ReceiveArena> receiveArena_; // 存储从bufferPool_分配 必须在bufferPool_之后构造
+    std::shared_ptr<ConnectionPool> connectionPool_; // 和ConnectionAllocator共同持有 析构时detach
+    std::unique_ptr<ZeroCopyReaper> zeroCopyReaper_; // 用timerQueue_定期检查 必须在timerQueue_之后构造
 
     int wakeupFd_; // 作用：当mainLoop获取一个新用户的Channel 需通过轮询算法选择一个subLoop 通过该成员唤醒subLoop处理Channel
     std::unique_ptr<Channel> wakeupChannel_;
 
     ChannelList activeChannels_; // 返回Poller检测到当前有事件发生的所有Channel列表
 
+    std::atomic<int64_t> numConnections_; // 本loop上的连接数
+    std::atomic<int64_t> pendingBytes_;   // 本loop上所有连接outputBuffer_中待发送的字节数
+
+    int cpu_;      // 绑定的CPU
+    int numaNode_; // 绑定的NUMA节点
+
+    int busyPollMicros_;       // 有事件后空转的时间预算 0表示不忙轮询
+    int socketBusyPollMicros_; // 内核态忙轮询时间
+    // 忙轮询统计 只由loop线程写
+    std::atomic<int64_t> spinMicros_;
+    std::atomic<int64_t> workMicros_;
+    std::atomic<int64_t> blockMicros_;
+    std::atomic<int64_t> spinPolls_;
+
     std::atomic_bool callingPendingFunctors_; // 标识当前loop是否有需要执行的回调操作
-    std::vector<Functor> pendingFunctors_;    // 存储loop需要执行的所有回调操作
-    std::mutex mutex_;                        // 互斥锁 用来保护上面vector容器的线程安全操作
+    MpscQueue<Functor> pendingFunctors_;      // 存储loop需要执行的所有回调操作 无锁多生产者单消费者队列
 };
\ No newline at end of file
@@ -15,8 +15,14 @@ class EventLoopThread : noncopyable
 public:
     using ThreadInitCallback = std::function<void(EventLoop *)>;
 
+    /**
+     * cpu >= 0 时线程启动后先绑定到该CPU
+     * bindNumaMemory 为true时 线程的内存分配优先使用该CPU所在的NUMA节点
+     **/
     EventLoopThread(const ThreadInitCallback &cb = ThreadInitCallback(),
-                    const std::string &name = std::string());
+                    const std::string &name = std::string(),
+                    int cpu = -1,
+                    bool bindNumaMemory = false);
     ~EventLoopThread();
     
     EventLoop *startLoop(); // 主线程执行startLoop，创建新线程，开启loop
@@ -42,4 +48,6 @@ private:
     std::mutex mutex_;             // 互斥锁
     std::condition_variable cond_; // 条件变量
     ThreadInitCallback callback_;  // 线程初始化回调函数
+    const int cpu_;                // 绑定的CPU -1表示不绑定
+    const bool bindNumaMemory_;    // 是否把内存分配绑定到CPU所在的NUMA节点
 };
\ No newline at end of file
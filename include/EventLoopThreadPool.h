@@ -4,25 +4,50 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <utility>
+#include <stdint.h>
 
 #include "noncopyable.h"
 class EventLoop;
 class EventLoopThread;
+class InetAddress;
  
 class EventLoopThreadPool : noncopyable
 {
 public:
     using ThreadInitCallback = std::function<void(EventLoop *)>;
 
+    // 新连接分发策略
+    enum DispatchPolicy
+    {
+        kRoundRobin,          // 轮询(默认)
+        kLeastConnections,    // 连接数最少的loop
+        kLeastPendingBytes,   // 待发送字节数最少的loop
+        kPowerOfTwoChoices,   // 随机选两个loop 取连接数较少的那个
+        kConsistentHash,      // 按对端IP一致性哈希 同一IP总是落到同一个loop
+    };
+
     EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg);
     ~EventLoopThreadPool();
 
     void setThreadNum(int numThreads) { numThreads_ = numThreads; }
 
+    /**
+     * 第i个subloop线程绑定到cpus[i % cpus.size()] 需在start()之前调用
+     * bindNumaMemory为true时 subloop线程的内存分配优先使用所绑CPU的NUMA节点
+     **/
+    void setCpuAffinity(const std::vector<int> &cpus, bool bindNumaMemory = false)
+    { cpus_ = cpus; bindNumaMemory_ = bindNumaMemory; }
+
     void start(const ThreadInitCallback &cb = ThreadInitCallback());
 
+    // 需在start()之前调用
+    void setDispatchPolicy(DispatchPolicy policy) { policy_ = policy; }
+
     // 如果工作在多线程中，baseLoop_(mainLoop)会默认以轮询的方式分配Channel给subLoop
     EventLoop *getNextLoop();
+    // 按分发策略为新连接选择subLoop 只在baseLoop_线程中调用
+    EventLoop *getNextLoop(const InetAddress &peerAddr);
 
     std::vector<EventLoop *> getAllLoops(); // 获取所有的EventLoop
 
@@ -30,6 +55,12 @@ public:
     const std::string name() const { return name_; } // 获取名字
 
 private:
+    // 一致性哈希环上每个loop的虚拟节点数
+    static const int kVirtualNodesPerLoop = 160;
+
+    void buildHashRing();
+    uint32_t nextRandom(); // xorshift 只在baseLoop_线程中调用
+
     EventLoop *baseLoop_; // 用户使用muduo创建的loop 如果线程数为1 那直接使用用户创建的loop 否则创建多EventLoop
     std::string name_;//线程池名称，通常由用户指定，线程池中EventLoopThread名称依赖于线程池名称。
     bool started_;//是否已经启动标志
@@ -37,4 +68,10 @@ private:
     int next_; // 新连接到来，所选择EventLoop的索引
     std::vector<std::unique_ptr<EventLoopThread>> threads_;//IO线程的列表
     std::vector<EventLoop *> loops_;//线程池中EventLoop的列表，指向的是EVentLoopThread线程函数创建的EventLoop对象。
+    std::vector<int> cpus_; // subloop线程绑定的CPU列表 为空表示不绑定
+    bool bindNumaMemory_;   // 是否绑定NUMA内存
+
+    DispatchPolicy policy_;
+    uint32_t randomState_;
+    std::vector<std::pair<uint32_t, EventLoop *>> hashRing_; // 按哈希值排序的虚拟节点
 };
\ No newline at end of file
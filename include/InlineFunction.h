@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * 只能移动的函数对象 用于EventLoop::Functor和Channel的事件回调 代替std::function
+ *
+ * std::function的内联存储只有16字节 捕获shared_ptr<TcpConnection>再加参数(如Slice)就要在堆上分配
+ * 而且只能拷贝: runInLoop/queueInLoop之间传递一次就多一次分配和引用计数加减
+ * 这里内联存储kInlineFunctionCapacity字节 bind(成员函数指针, shared_ptr, Slice)正好放得下
+ * 放不下(或移动构造可能抛异常)的可调用对象才退回到堆上 保证任意可调用对象都能使用
+ **/
+static const size_t kInlineFunctionCapacity = 64;
+
+template <typename Signature, size_t Capacity = kInlineFunctionCapacity>
+class InlineFunction;
+
+template <typename R, typename... Args, size_t Capacity>
+class InlineFunction<R(Args...), Capacity>
+{
+public:
+    InlineFunction() noexcept
+        : ops_(nullptr)
+    {
+    }
+    InlineFunction(std::nullptr_t) noexcept
+        : ops_(nullptr)
+    {
+    }
+    template <typename F,
+              typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, InlineFunction>::value>::type>
+    InlineFunction(F &&f)
+        : ops_(nullptr)
+    {
+        assign(std::forward<F>(f));
+    }
+    InlineFunction(InlineFunction &&other) noexcept
+        : ops_(other.ops_)
+    {
+        if (ops_)
+        {
+            ops_->move(&other.storage_, &storage_);
+            other.ops_ = nullptr;
+        }
+    }
+    InlineFunction(const InlineFunction &) = delete;
+    InlineFunction &operator=(const InlineFunction &) = delete;
+
+    ~InlineFunction() { reset(); }
+
+    InlineFunction &operator=(InlineFunction &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            if (other.ops_)
+            {
+                other.ops_->move(&other.storage_, &storage_);
+                ops_ = other.ops_;
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+    InlineFunction &operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+    template <typename F,
+              typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, InlineFunction>::value>::type>
+    InlineFunction &operator=(F &&f)
+    {
+        reset();
+        assign(std::forward<F>(f));
+        return *this;
+    }
+
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+    R operator()(Args... args) const
+    {
+        if (ops_ == nullptr)
+        {
+            throw std::bad_function_call();
+        }
+        return ops_->invoke(&storage_, std::forward<Args>(args)...);
+    }
+
+    // 可调用对象是否存放在内联存储中 不需要堆分配
+    template <typename F>
+    static constexpr bool storedInline()
+    {
+        return sizeof(F) <= Capacity && alignof(F) <= alignof(Storage)
+            && std::is_nothrow_move_constructible<F>::value;
+    }
+
+private:
+    using Storage = typename std::aligned_storage<Capacity, alignof(void *)>::type;
+
+    // 每种可调用对象一张操作表 对象本身只多一个指针
+    struct Ops
+    {
+        R (*invoke)(void *storage, Args &&...args);
+        void (*move)(void *from, void *to); // 移动构造到to 并析构from
+        void (*destroy)(void *storage);
+    };
+
+    template <typename F>
+    struct InlineOps
+    {
+        static R invoke(void *storage, Args &&...args)
+        {
+            return static_cast<R>((*static_cast<F *>(storage))(std::forward<Args>(args)...));
+        }
+        static void move(void *from, void *to)
+        {
+            F *src = static_cast<F *>(from);
+            ::new (to) F(std::move(*src));
+            src->~F();
+        }
+        static void destroy(void *storage) { static_cast<F *>(storage)->~F(); }
+    };
+
+    template <typename F>
+    struct HeapOps
+    {
+        static R invoke(void *storage, Args &&...args)
+        {
+            return static_cast<R>((**static_cast<F **>(storage))(std::forward<Args>(args)...));
+        }
+        static void move(void *from, void *to) { ::new (to) F *(*static_cast<F **>(from)); }
+        static void destroy(void *storage) { delete *static_cast<F **>(storage); }
+    };
+
+    // 空的函数指针和std::function构造出来的也是空的 与std::function一致
+    template <typename F>
+    static bool isNull(const F &) { return false; }
+    template <typename F>
+    static bool isNull(F *f) { return f == nullptr; }
+    template <typename S>
+    static bool isNull(const std::function<S> &f) { return !f; }
+
+    template <typename F>
+    void assign(F &&f)
+    {
+        using Fn = typename std::decay<F>::type;
+        if (isNull(f))
+        {
+            return;
+        }
+        construct<Fn>(std::forward<F>(f), std::integral_constant<bool, storedInline<Fn>()>());
+    }
+
+    template <typename Fn, typename F>
+    void construct(F &&f, std::true_type)
+    {
+        static const Ops ops = {&InlineOps<Fn>::invoke, &InlineOps<Fn>::move, &InlineOps<Fn>::destroy};
+        ::new (&storage_) Fn(std::forward<F>(f));
+        ops_ = &ops;
+    }
+
+    template <typename Fn, typename F>
+    void construct(F &&f, std::false_type)
+    {
+        static const Ops ops = {&HeapOps<Fn>::invoke, &HeapOps<Fn>::move, &HeapOps<Fn>::destroy};
+        ::new (&storage_) Fn *(new Fn(std::forward<F>(f)));
+        ops_ = &ops;
+    }
+
+    void reset() noexcept
+    {
+        if (ops_)
+        {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    mutable Storage storage_;
+    const Ops *ops_;
+};
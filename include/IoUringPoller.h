@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+#include "Poller.h"
+#include "Timestamp.h"
+
+class Channel;
+
+/**
+ * IoUringPoller 是 Poller 的子类 基于io_uring的IORING_OP_POLL_ADD实现
+ *
+ * 与EPollPoller相比：
+ *   1. 所有的注册/修改/删除都只是往SQ里写一个sqe 在下一次poll()时与等待合并成一次io_uring_enter
+ *   2. poll请求是一次性的 触发后在下一次poll()开头重新挂上(也只是写sqe) 保证和epoll LT模式相同的语义
+ *      (没读完的数据下一轮仍然会通知 不会像multishot那样只在新数据到达时才通知)
+ *
+ * 每个poll请求的user_data = fd << 32 | generation 重新挂载/删除后旧请求的完成事件因generation不匹配被丢弃
+ * 内核不支持io_uring(或被禁用)时Poller::newDefaultPoller会退回EPollPoller
+ **/
+class IoUringPoller : public Poller
+{
+public:
+    IoUringPoller(EventLoop *loop);
+    ~IoUringPoller() override;
+
+    Timestamp poll(int timeoutMs, ChannelList *activeChannels) override;
+    void updateChannel(Channel *channel) override;
+    void removeChannel(Channel *channel) override;
+
+    // 探测当前内核能否使用io_uring
+    static bool isSupported();
+
+private:
+    static const unsigned kRingEntries = 4096;
+    static const uint64_t kRemoveUserData = ~0ULL; // POLL_REMOVE请求自身的user_data 完成事件直接忽略
+
+    // 每个fd在io_uring中的状态
+    struct PollState
+    {
+        uint32_t generation; // 每次挂载poll请求都递增
+        bool armed;          // 内核中是否有该fd未完成的poll请求
+    };
+
+    // 从SQ中取一个空闲的sqe SQ满时先提交
+    io_uring_sqe *getSqe();
+    // 挂载一次性poll请求
+    void arm(Channel *channel, PollState &state);
+    // 撤销未完成的poll请求
+    void disarm(int fd, PollState &state);
+    // 收割CQ中的完成事件 填充activeChannels
+    void fillActiveChannels(ChannelList *activeChannels);
+    // 调用io_uring_enter 提交sqe并等待至少minComplete个完成事件
+    int enter(unsigned minComplete, int timeoutMs);
+
+    int ringfd_;
+
+    // SQ ring
+    void *sqRingPtr_;
+    size_t sqRingSize_;
+    unsigned *sqHead_;
+    unsigned *sqTail_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    unsigned *sqArray_;
+    io_uring_sqe *sqes_;
+    size_t sqesSize_;
+    unsigned sqeTail_;   // 本地的SQ尾 提交前才写回sqTail_
+    unsigned toSubmit_;  // 尚未提交给内核的sqe数
+
+    // CQ ring
+    void *cqRingPtr_;
+    size_t cqRingSize_;
+    unsigned *cqHead_;
+    unsigned *cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe *cqes_;
+
+    std::unordered_map<int, PollState> states_;
+    std::vector<int> rearmFds_; // 上一轮触发过的fd 下一次poll()前重新挂载
+};
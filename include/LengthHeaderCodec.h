@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Slice.h"
+#include "Timestamp.h"
+
+class Buffer;
+
+/**
+ * 长度头分帧编解码: 每帧是4字节网络字节序的正文长度 + 正文
+ * 收: 作为MessageCallback 每次可读事件把inputBuffer_中所有完整的帧一次交给FramesCallback
+ *     帧是直接指向inputBuffer_的Frame(不持有数据) 只在回调期间有效 回调返回后统一取走
+ *     需要保留或者转发时用Frame::copy拷贝成Slice 长度非法时关闭连接
+ * 发: 正文先写在Buffer里 长度头写到Buffer预留的prependable空间 和正文连续 整体发送 正文不拷贝
+ **/
+class LengthHeaderCodec : noncopyable
+{
+public:
+    // 帧的正文 不是Slice: 没有持有者 不能交给send或者Buffer排队
+    class Frame
+    {
+    public:
+        Frame(const char *data, size_t size) : data_(data), size_(size) {}
+
+        const char *data() const { return data_; }
+        size_t size() const { return size_; }
+        std::string toString() const { return std::string(data_, size_); }
+        Slice copy() const { return Slice::copyFrom(data_, size_); }
+
+    private:
+        const char *data_;
+        size_t size_;
+    };
+
+    using FramesCallback = std::function<void(const TcpConnectionPtr &, const std::vector<Frame> &, Timestamp)>;
+
+    explicit LengthHeaderCodec(const FramesCallback &cb, size_t maxFrameLength = kDefaultMaxFrameLength);
+
+    // 绑定到TcpServer::setMessageCallback 多个loop线程可以同时调用
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    // 在buf前面补上长度头 然后发送并取走buf中的全部数据
+    void send(const TcpConnectionPtr &conn, Buffer *buf) const;
+    // 正文拷贝到临时Buffer中再发送 正文已经在Buffer中时用上面的版本
+    void send(const TcpConnectionPtr &conn, const char *data, size_t len) const;
+    void send(const TcpConnectionPtr &conn, const std::string &message) const
+    { send(conn, message.data(), message.size()); }
+
+    static const size_t kHeaderLength = sizeof(int32_t);
+    static const size_t kDefaultMaxFrameLength = 64 * 1024 * 1024; // 64M
+
+private:
+    FramesCallback framesCallback_;
+    const size_t maxFrameLength_;
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+#include "noncopyable.h"
+
+/**
+ * 无锁的多生产者单消费者任务队列 用于EventLoop::queueInLoop
+ *
+ * 生产者(任意线程)：new一个节点 CAS压到链表头 不加锁
+ * 消费者(loop线程)：exchange一次把整条链表摘下来 反转成FIFO顺序后依次执行
+ * 与原来mutex + vector swap的语义相同：本次只执行摘下来的这一批 执行期间新加入的留到下一轮
+ *
+ * push返回队列之前是否为空 只有从空变为非空的那个生产者需要唤醒loop
+ * 后面的生产者说明已经有人唤醒过(或loop线程自己正在运行) 可以省掉eventfd的write
+ **/
+template <typename T>
+class MpscQueue : noncopyable
+{
+public:
+    MpscQueue()
+        : head_(nullptr)
+    {
+    }
+
+    ~MpscQueue()
+    {
+        Node *node = head_.load(std::memory_order_acquire);
+        while (node)
+        {
+            Node *next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    // 线程安全 返回push之前队列是否为空
+    bool push(T value)
+    {
+        Node *node = new Node(std::move(value));
+        Node *oldHead = head_.load(std::memory_order_relaxed);
+        do
+        {
+            node->next = oldHead;
+        } while (!head_.compare_exchange_weak(oldHead, node,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed));
+        return oldHead == nullptr;
+    }
+
+    // 只能由消费者线程调用 按push的先后顺序对当前的所有元素执行func 返回处理的个数
+    template <typename Func>
+    size_t consumeAll(Func &&func)
+    {
+        Node *node = head_.exchange(nullptr, std::memory_order_acquire);
+
+        // 链表是后进先出的 反转成先进先出
+        Node *reversed = nullptr;
+        while (node)
+        {
+            Node *next = node->next;
+            node->next = reversed;
+            reversed = node;
+            node = next;
+        }
+
+        size_t count = 0;
+        while (reversed)
+        {
+            Node *next = reversed->next;
+            func(reversed->value);
+            delete reversed;
+            reversed = next;
+            ++count;
+        }
+        return count;
+    }
+
+    bool empty() const { return head_.load(std::memory_order_acquire) == nullptr; }
+
+private:
+    struct Node
+    {
+        explicit Node(T &&v)
+            : value(std::move(v))
+            , next(nullptr)
+        {
+        }
+        T value;
+        Node *next;
+    };
+
+    std::atomic<Node *> head_;
+};
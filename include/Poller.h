@@ -1,7 +1,6 @@
 #pragma once
 
 #include <vector>
-#include <unordered_map>
 
 #include "noncopyable.h"
 #include "Timestamp.h"
@@ -26,14 +25,28 @@ public:
     // 判断参数channel是否在当前的Poller当中
     bool hasChannel(Channel *channel) const;
 
+    // 是否支持Channel的边缘触发模式
+    virtual bool edgeTriggeredSupported() const { return false; }
+    // 开启IO复用实例自身的内核忙轮询 不支持时返回false
+    virtual bool setBusyPoll(int /*usec*/) { return false; }
+
     // EventLoop可以通过该接口获取默认的IO复用的具体实现
     static Poller *newDefaultPoller(EventLoop *loop);
 
 protected:
-    // map的key:sockfd value:sockfd所属的channel通道类型
-    using ChannelMap = std::unordered_map<int, Channel *>;
+    // fd是从小到大分配的小整数 直接用fd做下标的数组代替哈希表 查找不需要计算哈希
+    // 下标:sockfd value:sockfd所属的channel通道类型 没有注册的位置为nullptr
+    using ChannelMap = std::vector<Channel *>;
+
+    Channel *findChannel(int fd) const
+    { return static_cast<size_t>(fd) < channels_.size() ? channels_[fd] : nullptr; }
+    void addChannel(int fd, Channel *channel);
+    void eraseChannel(int fd);
+    size_t numChannels() const { return numChannels_; }
+
     ChannelMap channels_;
 
 private:
+    size_t numChannels_;   // channels_中非空的个数
     EventLoop *ownerLoop_; // 定义Poller所属的事件循环EventLoop
 };
\ No newline at end of file
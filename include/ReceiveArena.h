@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "noncopyable.h"
+
+class BufferPool;
+
+/**
+ * Buffer::readFd用的接收区 每个EventLoop一个 代替每次调用都清零的64KB栈上extrabuf
+ * 只在所属loop线程中使用 存储从loop的BufferPool分配
+ *
+ * 大小在kMinSize到kMaxSize之间按最近的读取量自适应:
+ *   1. 一次readv把接收区填满 => 说明socket里还有数据 下次翻倍 减少read系统调用
+ *   2. 连续kWindow次读取用到的最大字节数不到容量的1/4 => 减半
+ * 链式Buffer读入的数据较多时 接收区的存储直接作为新块交给Buffer(release) 不再拷贝
+ **/
+class ReceiveArena : noncopyable
+{
+public:
+    explicit ReceiveArena(BufferPool *pool);
+    ~ReceiveArena();
+
+    // 本次readv使用的接收区 第一次使用或者被release之后重新分配
+    char *data();
+    size_t capacity() const { return capacity_; }
+    BufferPool *pool() const { return pool_; }
+
+    // 记录一次readv写入接收区的字节数 调整下次的大小
+    void record(size_t used);
+    // 把存储交给调用者(Buffer链式模式的新块) 接收区下次使用时重新分配
+    char *release();
+
+    static const size_t kMinSize = 16 * 1024;
+    static const size_t kMaxSize = 256 * 1024;
+    static const int kWindow = 64;
+
+private:
+    void resize(size_t capacity);
+
+    BufferPool *pool_;
+    char *data_;
+    size_t capacity_;
+    size_t windowMax_; // 本窗口内单次用到的最大字节数
+    int windowReads_;  // 本窗口内的读取次数
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <stddef.h>
+
+/**
+ * 引用计数的只读数据片段 拷贝只增加引用计数 不拷贝数据
+ * 同一份序列化好的消息可以广播给大量连接: 每个连接的outputBuffer_只保存引用 由writev直接发送
+ * 数据在最后一个引用释放时才释放(shared_ptr 跨线程安全) 期间不能修改
+ **/
+class Slice
+{
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    Slice()
+        : data_(nullptr)
+        , size_(0)
+    {
+    }
+    // 接管字符串 不拷贝
+    explicit Slice(std::string &&str)
+    {
+        std::shared_ptr<std::string> holder = std::make_shared<std::string>(std::move(str));
+        data_ = holder->data();
+        size_ = holder->size();
+        holder_ = std::move(holder);
+    }
+    explicit Slice(const std::shared_ptr<const std::string> &str)
+        : holder_(str)
+        , data_(str->data())
+        , size_(str->size())
+    {
+    }
+    // 任意的持有者 [data, data+size)在holder释放之前有效
+    Slice(std::shared_ptr<const void> holder, const char *data, size_t size)
+        : holder_(std::move(holder))
+        , data_(data)
+        , size_(size)
+    {
+    }
+
+    static Slice copyFrom(const char *data, size_t size) { return Slice(std::string(data, size)); }
+
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const std::shared_ptr<const void> &holder() const { return holder_; }
+
+    // [offset, offset+len)的子片段 共享同一份数据
+    Slice sub(size_t offset, size_t len = npos) const
+    {
+        offset = offset < size_ ? offset : size_;
+        len = len < size_ - offset ? len : size_ - offset;
+        return Slice(holder_, data_ + offset, len);
+    }
+
+private:
+    std::shared_ptr<const void> holder_;
+    const char *data_;
+    size_t size_;
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "noncopyable.h"
+
+/**
+ * 64位的槽位ID: 高12位是调用者的标签(TcpServer用作loop分片号) 中间20位是槽位的代数 低32位是槽位下标
+ * 槽位被释放后代数加1 拿着旧ID查找会失败 不会误取到复用这个槽位的新对象
+ **/
+namespace SlotId {
+    const int kIndexBits = 32;
+    const int kGenerationBits = 20;
+    const int kTagBits = 12;
+    const uint32_t kGenerationMask = (1u << kGenerationBits) - 1;
+    const uint32_t kMaxTag = (1u << kTagBits) - 1;
+
+    inline uint64_t make(uint32_t tag, uint32_t generation, uint32_t index)
+    {
+        return (static_cast<uint64_t>(tag) << (kIndexBits + kGenerationBits))
+             | (static_cast<uint64_t>(generation & kGenerationMask) << kIndexBits)
+             | index;
+    }
+    inline uint32_t index(uint64_t id) { return static_cast<uint32_t>(id); }
+    inline uint32_t generation(uint64_t id) { return static_cast<uint32_t>(id >> kIndexBits) & kGenerationMask; }
+    inline uint32_t tag(uint64_t id) { return static_cast<uint32_t>(id >> (kIndexBits + kGenerationBits)); }
+}
+
+/**
+ * 代数标记的槽位表 插入返回SlotId 查找/删除都是O(1)的数组下标访问 没有哈希和字符串
+ * 释放的槽位放进空闲栈 优先复用最近释放的(缓存还热) 不加锁 只能在一个线程中使用
+ **/
+template <typename T>
+class SlotMap : noncopyable
+{
+public:
+    explicit SlotMap(uint32_t tag = 0) : tag_(tag), size_(0) {}
+
+    uint64_t insert(T value)
+    {
+        uint32_t index;
+        if (!freeList_.empty())
+        {
+            index = freeList_.back();
+            freeList_.pop_back();
+        }
+        else
+        {
+            index = static_cast<uint32_t>(slots_.size());
+            slots_.emplace_back();
+        }
+        Slot &slot = slots_[index];
+        slot.value = std::move(value);
+        slot.used = true;
+        ++size_;
+        return SlotId::make(tag_, slot.generation, index);
+    }
+
+    // 不存在或者已经被删除(代数不符)时返回nullptr
+    T *find(uint64_t id)
+    {
+        uint32_t index = SlotId::index(id);
+        if (index >= slots_.size() || SlotId::tag(id) != tag_)
+        {
+            return nullptr;
+        }
+        Slot &slot = slots_[index];
+        return slot.used && slot.generation == SlotId::generation(id) ? &slot.value : nullptr;
+    }
+
+    bool erase(uint64_t id)
+    {
+        T *value = find(id);
+        if (value == nullptr)
+        {
+            return false;
+        }
+        Slot &slot = slots_[SlotId::index(id)];
+        slot.value = T();
+        slot.used = false;
+        slot.generation = (slot.generation + 1) & SlotId::kGenerationMask;
+        freeList_.push_back(SlotId::index(id));
+        --size_;
+        return true;
+    }
+
+    // 取出所有对象并清空 代数全部前进 旧ID都会失效
+    std::vector<T> takeAll()
+    {
+        std::vector<T> values;
+        values.reserve(size_);
+        for (size_t i = 0; i < slots_.size(); ++i)
+        {
+            if (slots_[i].used)
+            {
+                values.push_back(std::move(slots_[i].value));
+                erase(SlotId::make(tag_, slots_[i].generation, static_cast<uint32_t>(i)));
+            }
+        }
+        return values;
+    }
+
+    size_t size() const { return size_; }
+    uint32_t tag() const { return tag_; }
+
+private:
+    struct Slot
+    {
+        Slot() : value(), generation(0), used(false) {}
+
+        T value;
+        uint32_t generation;
+        bool used;
+    };
+
+    const uint32_t tag_;
+    std::vector<Slot> slots_;
+    std::vector<uint32_t> freeList_; // 空闲槽位下标
+    size_t size_;
+};
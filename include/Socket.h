@@ -25,6 +25,9 @@ public:
     void setReuseAddr(bool on);
     void setReusePort(bool on);
     void setKeepAlive(bool on);
+    void setBusyPoll(int usec);
+    // 开启SO_ZEROCOPY 之后可以用MSG_ZEROCOPY发送 内核不支持时返回false
+    bool setZeroCopy(bool on);
 
 private:
     const int sockfd_;
@@ -0,0 +1,73 @@
+#pragma once
+
+/**
+ * 用户使用muduo编写客户端程序 一个TcpClient对应一个后端地址 最多同时持有一个连接
+ **/
+
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <string>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "InetAddress.h"
+#include "TcpConnection.h"
+#include "Connector.h"
+
+class EventLoop;
+
+/**
+ * 连接的建立和所有I/O都在构造时指定的loop中进行 connect/disconnect/stop线程安全
+ * 连接大量后端时 每个TcpClient用EventLoopThreadPool::getNextLoop()选择loop 连接就分散到各个subloop
+ * connect是非阻塞的(见Connector) 不会阻塞任何loop
+ * 析构需在loop线程中进行 或者在loop停止之后
+ **/
+class TcpClient : noncopyable
+{
+public:
+    TcpClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &nameArg);
+    ~TcpClient();
+
+    void connect();    // 发起连接 失败时按退避间隔重试直到连上或者stop()
+    void disconnect(); // 关闭已经建立的连接(等outputBuffer_发送完)
+    void stop();       // 停止正在进行的连接和重试
+
+    // 当前的连接 没有连上时为空 线程安全
+    TcpConnectionPtr connection() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return connection_;
+    }
+
+    EventLoop *getLoop() const { return loop_; }
+    const std::string &name() const { return name_; }
+    bool retry() const { return retry_; }
+    // 连接建立之后断开时自动重连 需在connect()之前调用
+    void enableRetry() { retry_ = true; }
+    // 连接失败后的重试间隔 见Connector::setRetryDelay 需在connect()之前调用
+    void setRetryDelay(int initialMs, int maxMs) { connector_->setRetryDelay(initialMs, maxMs); }
+
+    // 需在connect()之前调用 不是线程安全的
+    void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
+    void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
+
+private:
+    // 在loop线程中 由Connector在连接成功时调用
+    void newConnection(int sockfd);
+    // 在loop线程中 连接关闭时调用
+    void removeConnection(const TcpConnectionPtr &conn);
+
+    EventLoop *loop_;
+    std::shared_ptr<Connector> connector_;
+    const std::string name_;
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    WriteCompleteCallback writeCompleteCallback_;
+    bool retry_;   // 连接断开后是否重连
+    std::atomic_bool connect_; // 用户是否要求连接
+    int nextConnId_; // 只在loop线程中使用
+    mutable std::mutex mutex_;
+    TcpConnectionPtr connection_; // 由mutex_保护
+};
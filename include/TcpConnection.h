@@ -3,16 +3,21 @@
 #include <memory>
 #include <string>
 #include <atomic>
+#include <mutex>
+#include <vector>
+#include <utility>
+#include <stdint.h>
 
 #include "noncopyable.h" 
 #include "InetAddress.h"
 #include "Callbacks.h"
 #include "Buffer.h"
 #include "Timestamp.h"
+#include "Socket.h"
+#include "Channel.h"
+#include "InlineFunction.h"
 
-class Channel;
 class EventLoop;
-class Socket;
 
 /**
  * TcpServer => Acceptor => 有一个新用户连接，通过accept函数拿到connfd
@@ -22,26 +27,57 @@ class Socket;
 class TcpConnection : noncopyable, public std::enable_shared_from_this<TcpConnection>
 {
 public:
+    // 所属loop的连接数由创建者在分发时计入(loop->addConnections(1)) connectDestroyed中减去
     TcpConnection(EventLoop *loop,
                   const std::string &nameArg,
                   int sockfd,
                   const InetAddress &localAddr,
                   const InetAddress &peerAddr);
+    // 名字在第一次调用name()时才生成: namePrefix + 连接ID(分片.槽位.代数) 建立连接时不拼接字符串
+    TcpConnection(EventLoop *loop,
+                  const std::shared_ptr<const std::string> &namePrefix,
+                  int sockfd,
+                  const InetAddress &localAddr,
+                  const InetAddress &peerAddr);
     ~TcpConnection();
 
     EventLoop *getLoop() const { return loop_; }
-    const std::string &name() const { return name_; }
+    const std::string &name() const;
+    // TcpServer分配的连接ID(见SlotMap) 没有登记的连接为0
+    uint64_t id() const { return id_; }
+    // 由TcpServer在所属loop中登记后设置 需在connectEstablished之前调用
+    void setId(uint64_t id) { id_ = id; }
     const InetAddress &localAddress() const { return localAddr_; }
     const InetAddress &peerAddress() const { return peerAddr_; }
 
     bool connected() const { return state_ == kConnected; }
+    // 最近一次收发数据的时间 空闲连接回收使用
+    Timestamp lastActiveTime() const { return lastActive_; }
 
-    // 发送数据
+    // 发送数据 没能立即发完的部分拷贝到outputBuffer_
     void send(const std::string &buf);
+    // 接管字符串 没能立即发完的部分按引用排队 不拷贝
+    void send(std::string &&message);
+    // 发送并取走buf中的全部数据 在loop线程中调用且buf是链式模式时整块移到outputBuffer_ 不拷贝
+    void send(Buffer *buf);
+    // 发送引用计数的只读数据 同一个Slice发给多个连接时都只保存引用 用writev发送
+    void send(const Slice &slice);
     void sendFile(int fileDescriptor, off_t offset, size_t count); 
+    // 立即发出cork模式下攒下的数据 不等本轮循环结束 线程安全
+    void flush();
     
+    // 关闭Nagle算法 小包立即发出 配合cork模式由库来合并
+    void setTcpNoDelay(bool on);
+
+    // 暂停/恢复读取(取消/重新关注读事件) 对端的数据留在内核缓冲区里 由TCP流控让对端停止发送 线程安全
+    void startRead();
+    void stopRead();
+    bool isReading() const { return reading_; } // 用户是否要求读取 不包括背压暂停 不是线程安全的
+
     // 关闭半连接
     void shutdown();
+    // 强制关闭连接 不等待outputBuffer_发送完
+    void forceClose();
 
     void setConnectionCallback(const ConnectionCallback &cb)
     { connectionCallback_ = cb; }
@@ -51,8 +87,51 @@ public:
     { writeCompleteCallback_ = cb; }
     void setCloseCallback(const CloseCallback &cb)
     { closeCallback_ = cb; }
+    // 高/低水位回调和setBackpressure各用各的水位 互不影响
     void setHighWaterMarkCallback(const HighWaterMarkCallback &cb, size_t highWaterMark)
     { highWaterMarkCallback_ = cb; highWaterMark_ = highWaterMark; }
+    // outputBuffer_超过高水位之后又降到lowWaterMark及以下时回调 与高水位回调成对出现
+    void setLowWaterMarkCallback(const LowWaterMarkCallback &cb, size_t lowWaterMark)
+    { lowWaterMarkCallback_ = cb; lowWaterMark_ = lowWaterMark; }
+    // 实际的读取状态变化时回调(stopRead/startRead或者背压) 参数为变化后是否在读取
+    void setReadStateCallback(const ReadStateCallback &cb)
+    { readStateCallback_ = cb; }
+
+    /**
+     * 自动背压: outputBuffer_达到highWaterMark时暂停上游连接的读取 降到lowWaterMark及以下时恢复
+     * 没有指定上游时暂停的是自己(回显类服务) 代理把客户端连接设为后端连接的上游 反之亦然
+     * 一个上游可以被多个连接暂停 全部恢复后才重新读取 在loop线程中调用或者在connectEstablished之前设置
+     **/
+    void setBackpressure(bool on, size_t highWaterMark, size_t lowWaterMark);
+    // 上游可以在其他loop中 在本连接的loop线程中调用
+    void addUpstream(const TcpConnectionPtr &upstream);
+    void removeUpstream(const TcpConnectionPtr &upstream);
+
+    // 边缘触发模式 需在connectEstablished之前设置 Poller不支持时仍为水平触发
+    // ioBudget: 每次读/写事件最多处理的字节数 超出后让出本轮循环 防止一个连接独占loop
+    void setEdgeTriggered(bool on, size_t ioBudget) { ioBudget_ = on ? ioBudget : 0; }
+    // outputBuffer_使用链式模式(见Buffer::setChained) 需在connectEstablished之前设置
+    void setChainedOutput(bool on) { outputBuffer_.setChained(on); }
+    /**
+     * 不小于threshold字节的Slice和右值字符串用MSG_ZEROCOPY发送 内核直接引用数据 不拷贝到socket缓冲区
+     * 数据的持有者在内核通过错误队列确认发送完成之前一直被保留 需在connectEstablished之前设置
+     * 内核不支持或者确认时报告实际做了拷贝(如回环网卡)时 之后的发送自动退回普通write
+     **/
+    void setZeroCopy(bool on, size_t threshold = kDefaultZeroCopyThreshold)
+    { zeroCopyThreshold_ = on ? threshold : 0; }
+    bool zeroCopyEnabled() const { return zeroCopyThreshold_ > 0; }
+    /**
+     * cork模式: send不再立即write 数据先攒在outputBuffer_里 本轮循环末尾(处理完所有活跃事件之后)统一发出一次
+     * 一条消息分多次send(头部/正文/尾部)或者一次onMessage回复多条消息时 合并成一次write/writev
+     * 对延迟敏感的消息发完后调用flush()立即发出 在loop线程中调用或者在connectEstablished之前设置 关闭时立即发出攒下的数据
+     **/
+    void setCork(bool on);
+    bool corked() const { return corked_; }
+    // 所有零拷贝发送的数据都被内核释放时回调
+    void setZeroCopyCompleteCallback(const ZeroCopyCompleteCallback &cb)
+    { zeroCopyCompleteCallback_ = cb; }
+
+    static const size_t kDefaultZeroCopyThreshold = 64 * 1024; // 更小的数据拷贝比锁定页面和完成通知便宜
 
     // 连接建立
     void connectEstablished();
@@ -72,21 +151,70 @@ private:
 
     
     void handleRead(Timestamp receiveTime);
+    void handleReadEdgeTriggered(Timestamp receiveTime); // ET模式下读到EAGAIN为止
     void handleWrite();//处理写事件
     void handleClose();
     void handleError();
 
     void sendInLoop(const void *data, size_t len);
+    void sendStringInLoop(std::string &message);
+    void sendSliceInLoop(const Slice &slice);
+    void sendBufferInLoop(Buffer *buf);
+    // 没有排队的数据时直接write 返回写出的字节数
+    size_t writeIfIdle(const void *data, size_t len, bool *faultError);
+    // 处理直接write/writev的返回值 返回写出的字节数 全部写完时触发writeCompleteCallback_
+    size_t afterWrite(ssize_t nwrote, size_t len, bool *faultError);
+    // 没有排队的数据且不在cork模式时可以直接write
+    bool canWriteDirectly() const;
+    // 把outputBuffer_中的数据一次write/writev发出 没发完的关注可写事件
+    void flushInLoop();
+    // 在本loop中排队只捕获this的任务 连接已经断开时丢弃 见self_
+    void queueInLoopSelf(InlineFunction<void()> cb);
+    // outputBuffer_从oldLen增加了appended字节 检查高水位并关注可写事件(cork模式下安排本轮末尾flush)
+    void queuedOutput(size_t oldLen, size_t appended);
+    // 用MSG_ZEROCOPY发送slice 成功后保留slice的持有者直到内核确认 返回值同write
+    ssize_t sendZeroCopy(const Slice &slice);
+    bool zeroCopyEligible(size_t len) const { return zeroCopyThreshold_ > 0 && len >= zeroCopyThreshold_; }
+    // 读取错误队列里的零拷贝完成通知 释放对应的持有者 读到通知时返回true
+    bool handleZeroCopyCompletions();
+    // 连接销毁时还没完成的零拷贝发送交给loop的ZeroCopyReaper 见connectDestroyed
+    void parkZeroCopyPending();
+    void startReadInLoop();
+    void stopReadInLoop();
+    // 背压暂停(pause为true)或者恢复一次读取 线程安全
+    void throttleRead(bool pause);
+    void throttleReadInLoop(bool pause);
+    // 按reading_和readPauses_开关Channel的读事件
+    void updateReading();
+    // 暂停或者恢复所有上游
+    void throttleUpstreams(bool pause);
+    // outputBuffer_减少之后调用 降到低水位及以下时触发低水位回调并恢复上游
+    void outputDrained();
     void shutdownInLoop();
+    void forceCloseInLoop();
     void sendFileInLoop(int fileDescriptor, off_t offset, size_t count);
+    /**
+     * 本loop持有的引用 connectEstablished中设置 connectDestroyed之后由排在最后的回调释放
+     * 在此期间对象一定存活: Channel不再tie(每次事件不用weak_ptr::lock) 事件回调直接传self_
+     * 本loop线程中排队的回调只捕获this(经queueInLoopSelf) 这些都不需要原子的引用计数加减
+     * 连接断开(kDisconnected)之后各个*InLoop直接返回 queueInLoopSelf不再排队 释放self_的任务一定排在最后
+     * 在回调中关闭自己也是安全的 connectDestroyed总是排队执行 其他线程投递的回调仍然持有shared_ptr
+     **/
+    TcpConnectionPtr self_;
     EventLoop *loop_; // 这里是baseloop还是subloop由TcpServer中创建的线程数决定 若为多Reactor 该loop_指向subloop 若为单Reactor 该loop_指向baseloop
-    const std::string name_;
+    std::shared_ptr<const std::string> namePrefix_; // 名字前缀 为空表示构造时直接给了名字
+    uint64_t id_;
+    mutable std::once_flag nameOnce_; // name()可能在多个线程中第一次调用
+    mutable std::string name_;
     std::atomic_int state_;
-    bool reading_;//连接是否在监听读事件
+    bool reading_;//用户是否要求读取(startRead/stopRead)
+    int readPauses_; // 背压暂停的次数 为0且reading_时才关注读事件 只在loop_线程中读写
+    Timestamp lastActive_; // 最近一次收发数据的时间 只在loop_线程中读写
 
     // Socket Channel 这里和Acceptor类似    Acceptor => mainloop    TcpConnection => subloop
-    std::unique_ptr<Socket> socket_;
-    std::unique_ptr<Channel> channel_;
+    // 直接作为成员 和TcpConnection在同一块内存中(见ConnectionPool) 不单独分配 析构时先移除channel_再关闭fd
+    Socket socket_;
+    Channel channel_;
 
     const InetAddress localAddr_;
     const InetAddress peerAddr_;
@@ -97,7 +225,27 @@ private:
     WriteCompleteCallback writeCompleteCallback_; // 消息发送完成以后的回调
     HighWaterMarkCallback highWaterMarkCallback_; // 高水位回调
     CloseCallback closeCallback_; // 关闭连接的回调
-    size_t highWaterMark_; // 高水位阈值
+    LowWaterMarkCallback lowWaterMarkCallback_;   // 低水位回调
+    ReadStateCallback readStateCallback_;         // 读取暂停/恢复的回调
+    size_t highWaterMark_; // 高水位回调的阈值
+    size_t lowWaterMark_;  // 低水位回调的阈值
+    bool aboveHighWater_;  // outputBuffer_达到highWaterMark_后还没有降到lowWaterMark_ 低水位回调只在这之后触发
+    bool backpressure_;    // 是否开启自动背压
+    size_t backpressureHigh_; // 自动背压的水位 与高/低水位回调的分开设置
+    size_t backpressureLow_;
+    bool throttled_;       // 达到backpressureHigh_暂停了上游 还没有降到backpressureLow_
+    std::vector<std::weak_ptr<TcpConnection>> upstreams_; // 背压时暂停读取的连接 为空表示自己
+    size_t ioBudget_;      // ET模式下每次事件的读写字节上限 0表示水平触发
+
+    bool corked_;       // 是否为cork模式
+    bool flushQueued_;  // cork模式下本轮末尾的flush是否已经加入pendingFunctors_
+
+    // 零拷贝发送
+    size_t zeroCopyThreshold_; // 使用MSG_ZEROCOPY的最小字节数 0表示关闭
+    uint32_t zeroCopySeq_;     // 下一次零拷贝发送的序号 与内核中每个socket的计数一致
+    // 内核还在引用的数据 按序号排列 用vector是因为空的deque构造时也要分配内存 每个连接都要付出
+    std::vector<std::pair<uint32_t, std::shared_ptr<const void>>> zeroCopyPending_;
+    ZeroCopyCompleteCallback zeroCopyCompleteCallback_;
 
     // 数据缓冲区
     Buffer inputBuffer_;    // 接收数据的缓冲区
@@ -8,6 +8,7 @@
 #include <string>
 #include <memory>
 #include <atomic>
+#include <vector>
 #include <unordered_map>
 
 #include "EventLoop.h"
@@ -18,6 +19,8 @@
 #include "Callbacks.h"
 #include "TcpConnection.h"
 #include "Buffer.h"
+#include "TimingWheel.h"
+#include "SlotMap.h"
 
 // 对外的服务器编程使用的类
 class TcpServer
@@ -38,12 +41,45 @@ public:
     ~TcpServer();
 
     void setThreadInitCallback(const ThreadInitCallback &cb) { threadInitCallback_ = cb; }
+    // 回调和下面新连接的设置在start()时拷贝给各个loop 需在start()之前调用
     void setConnectionCallback(const ConnectionCallback &cb) { connectionCallback_ = cb; }
     void setMessageCallback(const MessageCallback &cb) { messageCallback_ = cb; }
     void setWriteCompleteCallback(const WriteCompleteCallback &cb) { writeCompleteCallback_ = cb; }
 
     // 设置底层subloop的个数
     void setThreadNum(int numThreads);
+    // subloop线程绑核 见EventLoopThreadPool::setCpuAffinity 需在start()之前调用
+    void setThreadCpuAffinity(const std::vector<int> &cpus, bool bindNumaMemory = false)
+    { threadPool_->setCpuAffinity(cpus, bindNumaMemory); }
+    // 新连接分发到subloop的策略 默认轮询 需在start()之前调用
+    void setDispatchPolicy(EventLoopThreadPool::DispatchPolicy policy)
+    { threadPool_->setDispatchPolicy(policy); }
+    // 空闲超过seconds秒(期间没有收发数据)的连接会被强制关闭 <=0表示不回收 需在start()之前调用
+    void setIdleTimeout(double seconds) { idleTimeout_ = seconds; }
+    // 新连接使用EPOLLET边缘触发 每次读/写事件最多处理ioBudget字节 需在start()之前调用
+    void setEdgeTriggered(bool on, size_t ioBudget = kDefaultIoBudget)
+    { edgeTriggered_ = on; ioBudget_ = ioBudget; }
+    /**
+     * 每个subloop各自创建一个SO_REUSEPORT的监听socket 在本线程accept并处理新连接
+     * 由内核在各个监听socket之间分配SYN mainloop不再参与accept 也没有跨线程投递
+     * 没有subloop(setThreadNum(0))时不生效 需在start()之前调用
+     **/
+    void setPerLoopAcceptors(bool on) { perLoopAcceptors_ = on; }
+    // 每次可读事件最多accept的连接数 见Acceptor::setAcceptBatch 需在start()之前调用
+    void setAcceptBatch(int batch) { acceptBatch_ = batch; acceptor_->setAcceptBatch(batch); }
+    // 新连接的outputBuffer_使用链式缓冲区 给慢速对端排队大量数据时不再realloc拷贝 需在start()之前调用
+    void setChainedOutputBuffer(bool on) { chainedOutput_ = on; }
+    // 新连接开启自动背压(暂停的是连接自己) 见TcpConnection::setBackpressure 需在start()之前调用
+    void setBackpressure(size_t highWaterMark, size_t lowWaterMark)
+    { backpressureHigh_ = highWaterMark; backpressureLow_ = lowWaterMark; }
+    // 新连接使用cork模式 同一轮循环中的send合并为一次write/writev 见TcpConnection::setCork 需在start()之前调用
+    void setCork(bool on) { cork_ = on; }
+    // 新连接的大块Slice/右值字符串用MSG_ZEROCOPY发送 见TcpConnection::setZeroCopy 需在start()之前调用
+    void setZeroCopy(bool on, size_t threshold = TcpConnection::kDefaultZeroCopyThreshold)
+    { zeroCopyThreshold_ = on ? threshold : 0; }
+    void setZeroCopyCompleteCallback(const ZeroCopyCompleteCallback &cb) { zeroCopyCompleteCallback_ = cb; }
+    // 每个loop的连接池预先分配perLoop个TcpConnection的内存 连接风暴时不用走malloc 见ConnectionPool 需在start()之前调用
+    void reserveConnections(size_t perLoop) { reservedConnections_ = perLoop; }
     /**
      * 如果没有监听, 就启动服务器(监听).
      * 多次调用没有副作用.
@@ -51,17 +87,56 @@ public:
      */
     void start();
 
+    // 按连接ID查找 ID失效(连接已经关闭)时返回空 必须在连接所属的loop线程中调用(分片不加锁)
+    TcpConnectionPtr findConnection(uint64_t id) const;
+
+    static const size_t kDefaultIoBudget = 1024 * 1024; // ET模式下每次事件默认最多读写1MB
+
 private:
+    // mainloop的Acceptor回调 按分发策略选择subloop
     void newConnection(int sockfd, const InetAddress &peerAddr);
-    void removeConnection(const TcpConnectionPtr &conn);
-    void removeConnectionInLoop(const TcpConnectionPtr &conn);
+    // 把新连接交给ioLoop 可以在任意Acceptor所在的线程中调用 本端地址取自接受连接的acceptor
+    void newConnectionInLoop(Acceptor *acceptor, EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr);
+    using ConnectionSlots = SlotMap<TcpConnectionPtr>;
 
-    using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
+    // 连接的关闭回调 不依赖TcpServer对象
+    static void removeConnection(ConnectionSlots *shard, const std::string *namePrefix, const TcpConnectionPtr &conn);
+
+    /**
+     * 建立连接需要的全部状态: 所属loop的分片和时间轮 以及新连接的回调和设置的拷贝
+     * start()中为每个loop创建一份 之后只读 投递到ioLoop的建立连接任务只持有它 不持有TcpServer
+     * TcpServer在accept之后、任务执行之前析构时 连接照常建立 再由析构时排在后面的任务销毁 fd不会泄漏
+     **/
+    struct LoopContext
+    {
+        EventLoop *loop;
+        std::shared_ptr<ConnectionSlots> shard;
+        std::shared_ptr<TimingWheel> wheel; // 没有设置空闲超时时为空
+        std::shared_ptr<const std::string> namePrefix;
+        ConnectionCallback connectionCallback;
+        MessageCallback messageCallback;
+        WriteCompleteCallback writeCompleteCallback;
+        ZeroCopyCompleteCallback zeroCopyCompleteCallback;
+        CloseCallback closeCallback;
+        bool edgeTriggered;
+        size_t ioBudget;
+        bool chainedOutput;
+        bool cork;
+        size_t backpressureHigh;
+        size_t backpressureLow;
+        size_t zeroCopyThreshold;
+    };
+    using LoopContextMap = std::unordered_map<EventLoop *, std::shared_ptr<const LoopContext>>;
+
+    // 在ioLoop线程中从本loop的连接池创建TcpConnection 登记并建立连接 只使用ctx
+    static void establishConnection(const std::shared_ptr<const LoopContext> &ctx, int sockfd,
+                                    const InetAddress &localAddr, const InetAddress &peerAddr);
 
     EventLoop *loop_; // 主循环（Main Reactor)，用户传入，运行在主线程
 
     const std::string ipPort_; // 监听地址（IP:Port），如 "127.0.0.1:8080"
     const std::string name_; // 服务器名称，用于日志和调试
+    const std::shared_ptr<const std::string> connNamePrefix_; // 连接名前缀 name-ip:port# 所有连接共享 后面接连接ID
 
     // 封装监听 socket 和连接接收逻辑，有新连接时触发 newConnection 回调。
     std::unique_ptr<Acceptor> acceptor_; // 连接接收器，运行在主循环，负责监听接口，接受新连接
@@ -72,10 +147,28 @@ private:
     ConnectionCallback connectionCallback_;       //有新连接时的回调
     MessageCallback messageCallback_;             // 有读写事件发生时的回调
     WriteCompleteCallback writeCompleteCallback_; // 消息发送完成后的回调
+    ZeroCopyCompleteCallback zeroCopyCompleteCallback_; // 零拷贝发送的数据被内核释放后的回调
 
     ThreadInitCallback threadInitCallback_; // loop线程初始化的回调
     int numThreads_;//线程池中线程的数量。
     std::atomic_int started_; // 原子变量，标记服务器是否已启动（避免重复启动）
-    int nextConnId_; // 连接 ID 计数器，为每个新连接分配唯一 ID
-    ConnectionMap connections_; // 保存所有的连接
+    // 保存所有的连接 每个loop一个分片 只在所属loop线程中增删 不加锁 关闭连接不用回到mainloop
+    // 下标即分片号(SlotId的标签) 与getAllLoops()一致 start()中创建 之后只读
+    std::vector<std::shared_ptr<ConnectionSlots>> connectionShards_;
+    LoopContextMap loopContexts_; // loop => 建立连接的状态 分发新连接时查找 start()中创建 之后只读
+
+    bool perLoopAcceptors_;                           // 是否每个subloop各自accept
+    int acceptBatch_;                                 // 每次可读事件最多accept的连接数
+    std::vector<std::unique_ptr<Acceptor>> loopAcceptors_; // subloop各自的Acceptor 下标与getAllLoops()一致 回调指向this 析构时等它们在各自loop中销毁完
+
+    double idleTimeout_;          // 空闲连接超时时间(秒) 每个loop一个时间轮 见LoopContext
+
+    bool edgeTriggered_; // 新连接是否使用边缘触发
+    size_t ioBudget_;    // 边缘触发模式下每次事件的读写字节上限
+    bool chainedOutput_; // 新连接的outputBuffer_是否使用链式模式
+    bool cork_;          // 新连接是否使用cork模式
+    size_t backpressureHigh_; // 新连接自动背压的高水位 0表示不开启
+    size_t backpressureLow_;  // 新连接自动背压的低水位
+    size_t zeroCopyThreshold_; // 新连接使用MSG_ZEROCOPY的最小字节数 0表示关闭
+    size_t reservedConnections_; // 每个loop的连接池预分配的个数
 };
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "Callbacks.h"
+
+// 定时器 记录到期时间、回调以及是否重复触发
+class Timer : noncopyable
+{
+public:
+    Timer(TimerCallback cb, Timestamp when, double interval)
+        : callback_(std::move(cb))
+        , expiration_(when)
+        , interval_(interval)
+        , repeat_(interval > 0.0)
+        , sequence_(++s_numCreated_)
+    {
+    }
+
+    void run() const { callback_(); }
+
+    Timestamp expiration() const { return expiration_; }
+    bool repeat() const { return repeat_; }
+    int64_t sequence() const { return sequence_; }
+
+    // 重复定时器在触发后重新计算下一次到期时间
+    void restart(Timestamp now);
+
+    static int64_t numCreated() { return s_numCreated_; }
+
+private:
+    const TimerCallback callback_; // 定时器到期后执行的回调
+    Timestamp expiration_;         // 到期时间
+    const double interval_;        // 重复间隔(秒) <=0 表示一次性定时器
+    const bool repeat_;            // 是否重复
+    const int64_t sequence_;       // 全局唯一序号 用于区分地址被复用的Timer
+
+    static std::atomic<int64_t> s_numCreated_;
+};
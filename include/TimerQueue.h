@@ -0,0 +1,58 @@
+#pragma once
+
+#include <set>
+#include <vector>
+#include <utility>
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "Callbacks.h"
+#include "Channel.h"
+
+class EventLoop;
+class Timer;
+class TimerId;
+
+/**
+ * 定时器队列 每个EventLoop持有一个
+ * 所有定时器共用一个timerfd 注册到Poller上 timerfd总是设置为最早到期的那个定时器的时间
+ * 定时器按(到期时间, Timer*)有序存放在std::set中 插入/取消都是O(logN)
+ **/
+class TimerQueue : noncopyable
+{
+public:
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    // 线程安全 可以在其他线程调用
+    TimerId addTimer(TimerCallback cb, Timestamp when, double interval);
+    // 线程安全 可以在其他线程调用
+    void cancel(TimerId timerId);
+
+private:
+    using Entry = std::pair<Timestamp, Timer *>;
+    using TimerList = std::set<Entry>;
+    using ActiveTimer = std::pair<Timer *, int64_t>;
+    using ActiveTimerSet = std::set<ActiveTimer>;
+
+    void addTimerInLoop(Timer *timer);
+    void cancelInLoop(TimerId timerId);
+    // timerfd可读 说明有定时器到期了
+    void handleRead();
+    // 取出所有已到期的定时器
+    std::vector<Entry> getExpired(Timestamp now);
+    // 重复定时器重新插入 一次性定时器释放
+    void reset(const std::vector<Entry> &expired, Timestamp now);
+    // 插入定时器 返回最早到期时间是否发生了变化
+    bool insert(Timer *timer);
+
+    EventLoop *loop_;
+    const int timerfd_;
+    Channel timerfdChannel_;
+    TimerList timers_; // 按到期时间排序
+
+    // 以下两个用于cancel 按Timer*排序
+    ActiveTimerSet activeTimers_;
+    bool callingExpiredTimers_;       // 是否正在执行到期定时器的回调
+    ActiveTimerSet cancelingTimers_;  // 回调执行期间被取消的定时器
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Timestamp.h"
+
+class EventLoop;
+
+/**
+ * 空闲连接回收用的哈希时间轮 每个subloop一个 只在所属loop线程中访问
+ *
+ * 连接每次收发数据只更新TcpConnection::lastActiveTime() 不操作时间轮 所以是O(1)且不分配内存
+ * 时间轮每个tick转动一格 只检查当前格子里的连接：
+ *   1. 连接已销毁或已断开 => 丢弃
+ *   2. 空闲时间超过idleTimeout => forceClose
+ *   3. 期间有过活动 => 按剩余时间重新放到后面的格子里(惰性重插)
+ * 每个连接在一个超时周期内最多被检查常数次 格子用vector存放并复用容量 稳定后不再分配内存
+ **/
+class TimingWheel : noncopyable, public std::enable_shared_from_this<TimingWheel>
+{
+public:
+    TimingWheel(EventLoop *loop, double idleTimeoutSeconds);
+
+    // 开始转动 必须在loop线程调用
+    void start();
+    // 新连接加入时间轮 必须在loop线程调用
+    void add(const TcpConnectionPtr &conn);
+
+    double idleTimeout() const { return idleTimeout_; }
+    size_t size() const { return size_; }
+
+private:
+    using WeakConnectionPtr = std::weak_ptr<TcpConnection>;
+    using Bucket = std::vector<WeakConnectionPtr>;
+
+    void onTick();
+    void place(const WeakConnectionPtr &conn, size_t ticksFromNow);
+
+    EventLoop *loop_;
+    const double idleTimeout_; // 空闲超时(秒)
+    const double tick_;        // 每格代表的时间(秒)
+    std::vector<Bucket> buckets_;
+    Bucket expiring_;          // 处理到期格子时与之交换 复用容量
+    size_t cursor_;            // 当前指向的格子
+    size_t size_;              // 时间轮中的连接数(含尚未清理的已断开连接)
+};
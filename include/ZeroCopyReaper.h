@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <stdint.h>
+
+#include "noncopyable.h"
+
+class EventLoop;
+
+/**
+ * 连接销毁时还没有收到完成通知的MSG_ZEROCOPY发送 每个EventLoop一个 只在所属loop线程中使用
+ *
+ * 内核在数据被确认、skb释放之后才发出完成通知 在这之前仍然引用用户的页面
+ * 连接销毁时先取走已经到达的通知 剩下的连同dup出来的fd一起停放在这里:
+ *   1. dup的fd让socket继续存在 完成通知仍然放进它的错误队列
+ *   2. 每隔kReapInterval秒读取一次错误队列 释放已经完成的holder
+ *   3. 全部完成后关闭fd 没有停放的连接时不占用定时器
+ * 对端一直不确认时 数据在TCP重传超时之后被丢弃 同样会产生完成通知
+ **/
+class ZeroCopyReaper : noncopyable
+{
+public:
+    // 已经发出的零拷贝发送: 序号和数据的holder
+    using Pending = std::vector<std::pair<uint32_t, std::shared_ptr<const void>>>;
+
+    explicit ZeroCopyReaper(EventLoop *loop);
+    ~ZeroCopyReaper(); // loop析构时 关闭还在等待的fd 释放剩下的holder
+
+    // 接管fd(调用者dup出来的) 等pending全部完成 需在loop线程中调用
+    void park(int fd, Pending pending);
+    size_t parked() const { return parked_.size(); }
+
+    // 取出fd错误队列中的零拷贝完成通知 从pending中删除已经完成的发送 返回是否收到了完成通知
+    // copied为内核是否做了拷贝(回环网卡或者网卡不支持分散聚合)
+    static bool reapCompletions(int fd, Pending *pending, bool *copied);
+
+    static const double kReapInterval;
+
+private:
+    struct Parked
+    {
+        int fd;
+        Pending pending;
+    };
+
+    void reap();
+
+    EventLoop *loop_;
+    std::vector<Parked> parked_;
+    bool scheduled_; // 是否已经安排了下一次reap
+};
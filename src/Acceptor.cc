@@ -2,6 +2,7 @@
 #include <sys/socket.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 #include "Acceptor.h"
 #include "Logger.h"
@@ -27,10 +28,25 @@ Acceptor::Acceptor(EventLoop *loop, const InetAddress &listenAddr, bool reusepor
     , acceptSocket_(createNonblocking())  // 初始化监听socket
     , acceptChannel_(loop, acceptSocket_.fd()) // 绑定loop和监听 fd
     , listenning_(false) 
+    , acceptBatch_(kDefaultAcceptBatch)
+    , idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC))
+    , localAddr_(listenAddr)
+    , localAddrKnown_(false)
 {
     acceptSocket_.setReuseAddr(true);   
     acceptSocket_.setReusePort(true);
     acceptSocket_.bindAddress(listenAddr); // 绑定监听地址
+    if (listenAddr.toPort() == 0)
+    {
+        // 端口由内核分配 取一次实际绑定的地址
+        sockaddr_in addr;
+        socklen_t addrlen = sizeof(addr);
+        if (::getsockname(acceptSocket_.fd(), (sockaddr *)&addr, &addrlen) == 0)
+        {
+            localAddr_.setSockAddr(addr);
+        }
+    }
+    localAddrKnown_ = localAddr_.getSockAddr()->sin_addr.s_addr != htonl(INADDR_ANY) && localAddr_.toPort() != 0;
     // TcpServer::start() => Acceptor.listen() 如果有新用户连接 要执行一个回调(accept => connfd => 打包成Channel => 唤醒subloop)
     // baseloop监听到有事件发生 => acceptChannel_(listenfd) => 执行该回调函数
     acceptChannel_.setReadCallback(
@@ -41,6 +57,10 @@ Acceptor::~Acceptor()
 {
     acceptChannel_.disableAll();    // 把从Poller中感兴趣的事件删除掉
     acceptChannel_.remove();        // 调用EventLoop->removeChannel => Poller->removeChannel 把Poller的ChannelMap对应的部分删除
+    if (idleFd_ >= 0)
+    {
+        ::close(idleFd_);
+    }
 }
 
 void Acceptor::listen()
@@ -51,27 +71,61 @@ void Acceptor::listen()
 }
 
 // listenfd有事件发生了，就是有新用户连接了
+// 一次最多accept acceptBatch_个连接 直到EAGAIN 避免积压的连接每个都要多一次epoll_wait
 void Acceptor::handleRead()
 {
-    InetAddress peerAddr;  //存客户端地址
-    int connfd = acceptSocket_.accept(&peerAddr);
-    if (connfd >= 0)
+    for (int i = 0; i < acceptBatch_; ++i)
     {
-        if (NewConnectionCallback_) // 如果设置了回调
+        InetAddress peerAddr;  //存客户端地址
+        int connfd = acceptSocket_.accept(&peerAddr);
+        if (connfd >= 0)
         {
-            NewConnectionCallback_(connfd, peerAddr); // 轮询找到subLoop 唤醒并分发当前的新客户端的Channel
+            if (NewConnectionCallback_) // 如果设置了回调
+            {
+                NewConnectionCallback_(connfd, peerAddr); // 轮询找到subLoop 唤醒并分发当前的新客户端的Channel
+            }
+            else
+            {
+                ::close(connfd);
+            }
+            continue;
         }
-        else
+
+        int savedErrno = errno;
+        if (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK)
         {
-            ::close(connfd);
+            break; // 已经取完
         }
-    }
-    else
-    {
-        LOG_ERROR("%s:%s:%d accept err:%d\n", __FILE__, __FUNCTION__, __LINE__, errno);
-        if (errno == EMFILE)
+        else if (savedErrno == EINTR || savedErrno == ECONNABORTED)
         {
+            continue; // 对端在accept之前就断开了 继续取下一个
+        }
+        else if (savedErrno == EMFILE || savedErrno == ENFILE)
+        {
+            // fd用完了 连接留在backlog里listenfd会一直可读(LT) loop会空转
+            // 借用预留的fd把连接取出来直接关闭 主动丢弃
             LOG_ERROR("%s:%s:%d sockfd reached limit\n", __FILE__, __FUNCTION__, __LINE__);
+            if (idleFd_ < 0)
+            {
+                break;
+            }
+            shedConnection();
+        }
+        else
+        {
+            LOG_ERROR("%s:%s:%d accept err:%d\n", __FILE__, __FUNCTION__, __LINE__, savedErrno);
+            break;
         }
     }
 }
+
+void Acceptor::shedConnection()
+{
+    ::close(idleFd_);
+    int connfd = ::accept(acceptSocket_.fd(), nullptr, nullptr);
+    if (connfd >= 0)
+    {
+        ::close(connfd);
+    }
+    idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
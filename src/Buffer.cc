@@ -1,8 +1,16 @@
 #include <errno.h>
+#include <limits.h>
 #include <sys/uio.h>
 #include <unistd.h>
 
 #include "Buffer.h"
+#include "ReceiveArena.h"
+#include "ByteSearch.h"
+
+const size_t Buffer::kCheapPrepend;
+const size_t Buffer::kInitialSize;
+const size_t Buffer::kBlockSize;
+const size_t Buffer::kMinReferenceBytes;
 
 /**
  * 从fd上读取数据 Poller工作在LT模式
@@ -15,7 +23,8 @@
 ssize_t Buffer::readFd(int fd, int *saveErrno)
 {
     // 栈额外空间，用于从套接字往出读时，当buffer_暂时不够用时暂存数据，待buffer_重新分配足够空间后，在把数据交换给buffer_。
-    char extrabuf[65536] = {0}; // 栈上内存空间 65536/1024 = 64KB
+    // 不要清零 readv只会写入 清零64KB每次都要多花几千个周期
+    char extrabuf[65536]; // 栈上内存空间 65536/1024 = 64KB
 
     /*
     struct iovec {
@@ -24,12 +33,18 @@ ssize_t Buffer::readFd(int fd, int *saveErrno)
     };
     */
 
+    // 存储已释放(或链式模式下最后一个块已满)时先分配 直接读进缓冲区里
+    if (chained_ ? writableBytes() == 0 : capacity_ == 0)
+    {
+        ensureWritableBytes(kInitialSize);
+    }
+
     // 使用iovec分配两个连续的缓冲区
     struct iovec vec[2];
     const size_t writable = writableBytes(); // 这是Buffer底层缓冲区剩余的可写空间大小 不一定能完全存储从fd读出的数据
 
     // 第一块缓冲区，指向可写空间
-    vec[0].iov_base = begin() + writerIndex_;
+    vec[0].iov_base = beginWrite();
     vec[0].iov_len = writable;
     // 第二块缓冲区，指向栈空间
     vec[1].iov_base = extrabuf;
@@ -48,12 +63,67 @@ ssize_t Buffer::readFd(int fd, int *saveErrno)
     }
     else if (n <= writable) // Buffer的可写缓冲区已经够存储读出来的数据了
     {
-        writerIndex_ += n;
+        hasWritten(n);
     }
     else // extrabuf里面也写入了n-writable长度的数据
     {
-        writerIndex_ = buffer_.size();
-        append(extrabuf, n - writable); // 对buffer_扩容 并将extrabuf存储的另一部分数据追加至buffer_
+        hasWritten(writable);
+        append(extrabuf, n - writable); // 对buffer_扩容(链式模式下追加新块) 并将extrabuf存储的另一部分数据追加进来
+    }
+    return n;
+}
+
+/**
+ * 和上面的readFd一样用readv读入两块缓冲区 第二块换成loop共享的接收区:
+ *   1. 不用每次在栈上准备64KB 接收区的大小随最近的读取量自适应 一次readv最多读Buffer可写空间+256KB
+ *   2. 链式模式下接收区读入的数据不少于接收区的一半时 整块存储直接挂到链尾 省掉一次拷贝
+ **/
+ssize_t Buffer::readFd(int fd, int *saveErrno, ReceiveArena *arena)
+{
+    if (chained_ ? writableBytes() == 0 : capacity_ == 0)
+    {
+        ensureWritableBytes(kInitialSize);
+    }
+
+    struct iovec vec[2];
+    const size_t writable = writableBytes();
+    vec[0].iov_base = beginWrite();
+    vec[0].iov_len = writable;
+    int iovcnt = 1;
+    if (writable < arena->capacity())
+    {
+        vec[1].iov_base = arena->data();
+        vec[1].iov_len = arena->capacity();
+        iovcnt = 2;
+    }
+    const ssize_t n = ::readv(fd, vec, iovcnt);
+
+    if (n < 0)
+    {
+        *saveErrno = errno;
+    }
+    else if (static_cast<size_t>(n) <= writable)
+    {
+        hasWritten(n);
+        if (iovcnt == 2)
+        {
+            arena->record(0);
+        }
+    }
+    else
+    {
+        const size_t extra = n - writable;
+        hasWritten(writable);
+        if (chained_ && extra >= arena->capacity() / 2)
+        {
+            blocks_->emplace_back(arena->release(), arena->capacity(), extra, arena->pool());
+            chainedBytes_ += extra;
+        }
+        else
+        {
+            append(arena->data(), extra);
+        }
+        arena->record(extra);
     }
     return n;
 }
@@ -62,10 +132,308 @@ ssize_t Buffer::readFd(int fd, int *saveErrno)
 // outputBuffer_.writeFd标示将数据写入到outputBuffer_中，从readerIndex_开始，可以写readableBytes()个字节
 ssize_t Buffer::writeFd(int fd, int *saveErrno)
 {
+    if (chained_)
+    {
+        return chainWriteFd(fd, saveErrno);
+    }
     ssize_t n = ::write(fd, peek(), readableBytes());
     if (n < 0)
     {
         *saveErrno = errno;
     }
     return n;
-}
\ No newline at end of file
+}
+
+void Buffer::setChained(bool on)
+{
+    if (on == chained_)
+    {
+        return;
+    }
+    if (on)
+    {
+        // 已有的数据搬进块里 释放线性缓冲区
+        std::string data = retrieveAllAsString();
+        releaseStorage();
+        if (!blocks_)
+        {
+            blocks_.reset(new std::deque<Block>);
+        }
+        chained_ = true;
+        chainAppend(data.data(), data.size());
+    }
+    else
+    {
+        std::string data = retrieveAllAsString();
+        chained_ = false;
+        append(data.data(), data.size());
+    }
+}
+
+// 在链尾追加一个至少有minWritable可写空间的块 第一个块前面预留kCheapPrepend
+void Buffer::pushBlock(size_t minWritable)
+{
+    if (!blocks_->empty() && blocks_->back().readableBytes() == 0)
+    {
+        blocks_->pop_back(); // 空块不留在链中间
+    }
+    size_t prepend = blocks_->empty() ? kCheapPrepend : 0;
+    blocks_->emplace_back(prepend + std::max(minWritable, kBlockSize), pool_);
+    blocks_->back().readerIndex = prepend;
+    blocks_->back().writerIndex = prepend;
+}
+
+void Buffer::prepend(const void *data, size_t len)
+{
+    if (chained_)
+    {
+        chainPrepend(data, len);
+        return;
+    }
+    if (len > prependableBytes())
+    {
+        // 预留空间不够(或者存储已经还给pool) 换一块前面留出len字节的存储
+        const size_t readable = readableBytes();
+        const size_t capacity = len + std::max(readable + writableBytes(), kInitialSize);
+        char *storage = PoolAllocator<char>(pool_).allocate(capacity);
+        if (buffer_)
+        {
+            ::memcpy(storage + len, peek(), readable);
+            PoolAllocator<char>(pool_).deallocate(buffer_, capacity_);
+        }
+        buffer_ = storage;
+        capacity_ = capacity;
+        readerIndex_ = len;
+        writerIndex_ = len + readable;
+    }
+    readerIndex_ -= len;
+    ::memcpy(begin() + readerIndex_, data, len);
+}
+
+// 第一个块是自己的存储且前面空间够时原地写入 否则在链头加一个只放这些数据的块
+void Buffer::chainPrepend(const void *data, size_t len)
+{
+    if (blocks_->empty() || blocks_->front().holder || blocks_->front().readerIndex < len)
+    {
+        if (!blocks_->empty() && blocks_->front().readableBytes() == 0)
+        {
+            blocks_->pop_front(); // 只剩一个空块 不留在链中间
+        }
+        size_t capacity = std::max(len, kCheapPrepend);
+        blocks_->emplace_front(capacity, pool_);
+        blocks_->front().readerIndex = capacity;
+        blocks_->front().writerIndex = capacity;
+    }
+    Block &front = blocks_->front();
+    front.readerIndex -= len;
+    ::memcpy(front.peek(), data, len);
+    chainedBytes_ += len;
+}
+
+void Buffer::chainAppend(const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        if (writableBytes() == 0)
+        {
+            pushBlock(kBlockSize);
+        }
+        Block &block = blocks_->back();
+        size_t n = std::min(len, block.writableBytes());
+        ::memcpy(block.beginWrite(), data, n);
+        block.writerIndex += n;
+        chainedBytes_ += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void Buffer::chainRetrieve(size_t len)
+{
+    if (len >= chainedBytes_)
+    {
+        retrieveAll();
+        return;
+    }
+    chainedBytes_ -= len;
+    while (len > 0)
+    {
+        Block &front = blocks_->front();
+        if (len < front.readableBytes())
+        {
+            front.readerIndex += len;
+            break;
+        }
+        len -= front.readableBytes();
+        blocks_->pop_front(); // 发送完的块直接释放
+    }
+}
+
+std::string Buffer::chainRetrieveAsString(size_t len)
+{
+    len = std::min(len, chainedBytes_);
+    std::string result;
+    result.reserve(len);
+    for (const Block &block : *blocks_)
+    {
+        if (result.size() == len)
+        {
+            break;
+        }
+        result.append(block.peek(), std::min(len - result.size(), block.readableBytes()));
+    }
+    chainRetrieve(len);
+    return result;
+}
+
+// 可读数据跨越多个块时 合并到一个新块中再返回 一个块能放下时不拷贝
+const char *Buffer::chainPeek() const
+{
+    if (blocks_->empty())
+    {
+        return begin();
+    }
+    if (blocks_->front().readableBytes() < chainedBytes_)
+    {
+        Block merged(kCheapPrepend + chainedBytes_, pool_);
+        merged.readerIndex = kCheapPrepend;
+        merged.writerIndex = kCheapPrepend;
+        for (const Block &block : *blocks_)
+        {
+            ::memcpy(merged.beginWrite(), block.peek(), block.readableBytes());
+            merged.writerIndex += block.readableBytes();
+        }
+        blocks_->clear();
+        blocks_->push_back(std::move(merged));
+    }
+    return blocks_->front().peek();
+}
+
+// 链式模式下用writev一次发送多个块 最多IOV_MAX个
+ssize_t Buffer::chainWriteFd(int fd, int *saveErrno)
+{
+    struct iovec vec[IOV_MAX];
+    int iovcnt = 0;
+    for (const Block &block : *blocks_)
+    {
+        if (iovcnt == IOV_MAX)
+        {
+            break;
+        }
+        if (block.readableBytes() > 0)
+        {
+            vec[iovcnt].iov_base = block.peek();
+            vec[iovcnt].iov_len = block.readableBytes();
+            ++iovcnt;
+        }
+    }
+    ssize_t n = ::writev(fd, vec, iovcnt);
+    if (n < 0)
+    {
+        *saveErrno = errno;
+    }
+    return n;
+}
+void Buffer::append(const Slice &slice)
+{
+    if (!chained_ || slice.size() < kMinReferenceBytes || !slice.holder())
+    {
+        // 没有持有者时数据随时可能失效 不能只保存引用
+        append(slice.data(), slice.size());
+        return;
+    }
+    if (!blocks_->empty() && blocks_->back().readableBytes() == 0)
+    {
+        blocks_->pop_back(); // 空块不留在链中间
+    }
+    blocks_->emplace_back(slice);
+    chainedBytes_ += slice.size();
+}
+
+void Buffer::append(Buffer *other)
+{
+    if (!chained_ || !other->chained_)
+    {
+        append(other->peek(), other->readableBytes());
+        other->retrieveAll();
+        return;
+    }
+    if (!blocks_->empty() && blocks_->back().readableBytes() == 0)
+    {
+        blocks_->pop_back();
+    }
+    for (Block &block : *other->blocks_)
+    {
+        if (block.readableBytes() > 0)
+        {
+            blocks_->push_back(std::move(block));
+        }
+    }
+    chainedBytes_ += other->chainedBytes_;
+    other->blocks_->clear();
+    other->chainedBytes_ = 0;
+}
+
+Slice Buffer::frontReference() const
+{
+    if (!chained_ || blocks_->empty() || !blocks_->front().holder)
+    {
+        return Slice();
+    }
+    const Block &front = blocks_->front();
+    return Slice(front.holder, front.peek(), front.readableBytes());
+}
+
+const char *Buffer::findCRLF(const char *start) const
+{
+    return ByteSearch::findPair(start, peek() + readableBytes(), '\r', '\n');
+}
+
+const char *Buffer::findCRLF(size_t *resume) const
+{
+    return findResumable(2, resume, [](const char *begin, const char *end) {
+        return ByteSearch::findPair(begin, end, '\r', '\n');
+    });
+}
+
+const char *Buffer::findByte(const char *start, char c) const
+{
+    return ByteSearch::findByte(start, peek() + readableBytes(), c);
+}
+
+const char *Buffer::findByte(char c, size_t *resume) const
+{
+    return findResumable(1, resume, [c](const char *begin, const char *end) {
+        return ByteSearch::findByte(begin, end, c);
+    });
+}
+
+const char *Buffer::findSeq(const char *start, const char *needle, size_t len) const
+{
+    return ByteSearch::findSeq(start, peek() + readableBytes(), needle, len);
+}
+
+const char *Buffer::findSeq(const char *needle, size_t len, size_t *resume) const
+{
+    return findResumable(len, resume, [needle, len](const char *begin, const char *end) {
+        return ByteSearch::findSeq(begin, end, needle, len);
+    });
+}
+
+template <typename Finder>
+const char *Buffer::findResumable(size_t len, size_t *resume, Finder find) const
+{
+    const char *begin = peek();
+    const size_t readable = readableBytes();
+    const char *hit = find(begin + std::min(*resume, readable), begin + readable);
+    if (hit != nullptr)
+    {
+        *resume = hit - begin; // 数据没被取走时再找一次仍然从这里命中
+    }
+    else
+    {
+        // 最后len-1个字节可能是被截断的模式的开头 下次从那里开始
+        *resume = readable >= len ? readable - len + 1 : 0;
+    }
+    return hit;
+}
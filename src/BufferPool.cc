@@ -0,0 +1,156 @@
+#include <new>
+#include <algorithm>
+#include <functional>
+
+#include "BufferPool.h"
+#include "EventLoop.h"
+
+const size_t BufferPool::kDefaultMaxCachedBytes;
+const double BufferPool::kTrimInterval = 10.0;
+
+// 级别大小: 1K到64K 每级之间相差1.5倍或4/3倍 浪费不超过1/3
+// 多留64字节给Buffer的kCheapPrepend 让常见的kCheapPrepend + 2^n正好落在一级中
+static const size_t kClassSizes[] = {
+    1024, 1536, 2048, 3072, 4096, 6144, 8192, 12288,
+    16384, 24576, 32768, 49152, 65536};
+static const size_t kClassSlack = 64;
+
+BufferPool::BufferPool(EventLoop *loop)
+    : loop_(loop)
+    , maxCachedBytes_(kDefaultMaxCachedBytes)
+    , trimming_(false)
+    , hits_(0)
+    , misses_(0)
+    , cachedBytes_(0)
+    , inUseBytes_(0)
+    , foreignBytes_(0)
+{
+    for (size_t size : kClassSizes)
+    {
+        SizeClass sc;
+        sc.size = size + kClassSlack;
+        sc.lowWater = 0;
+        classes_.push_back(sc);
+    }
+}
+
+BufferPool::~BufferPool()
+{
+    for (SizeClass &sc : classes_)
+    {
+        for (void *p : sc.free)
+        {
+            ::operator delete(p);
+        }
+    }
+}
+
+int BufferPool::sizeClass(size_t size) const
+{
+    for (size_t i = 0; i < classes_.size(); ++i)
+    {
+        if (size <= classes_[i].size)
+        {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+void *BufferPool::allocate(size_t size)
+{
+    int idx = sizeClass(size);
+    if (!loop_->isInLoopThread())
+    {
+        // 冷路径 不碰空闲链表 仍按级别大小申请 之后可能在loop线程中归还到空闲链表
+        size_t bytes = idx < 0 ? size : classes_[idx].size;
+        foreignBytes_.fetch_add(bytes, std::memory_order_relaxed);
+        return ::operator new(bytes);
+    }
+
+    if (!trimming_)
+    {
+        trimming_ = true;
+        loop_->runEvery(kTrimInterval, std::bind(&BufferPool::trim, this));
+    }
+
+    if (idx < 0)
+    {
+        addRelaxed(misses_, 1);
+        addRelaxed(inUseBytes_, size);
+        return ::operator new(size);
+    }
+
+    SizeClass &sc = classes_[idx];
+    addRelaxed(inUseBytes_, sc.size);
+    if (sc.free.empty())
+    {
+        addRelaxed(misses_, 1);
+        return ::operator new(sc.size);
+    }
+    void *p = sc.free.back();
+    sc.free.pop_back();
+    sc.lowWater = std::min(sc.lowWater, sc.free.size());
+    addRelaxed(hits_, 1);
+    addRelaxed(cachedBytes_, -static_cast<int64_t>(sc.size));
+    return p;
+}
+
+void BufferPool::deallocate(void *p, size_t size)
+{
+    int idx = sizeClass(size);
+    if (!loop_->isInLoopThread())
+    {
+        // 冷路径 不碰空闲链表
+        foreignBytes_.fetch_add(-static_cast<int64_t>(idx < 0 ? size : classes_[idx].size), std::memory_order_relaxed);
+        ::operator delete(p);
+        return;
+    }
+
+    if (idx < 0)
+    {
+        addRelaxed(inUseBytes_, -static_cast<int64_t>(size));
+        ::operator delete(p);
+        return;
+    }
+
+    SizeClass &sc = classes_[idx];
+    addRelaxed(inUseBytes_, -static_cast<int64_t>(sc.size));
+    if (static_cast<size_t>(cachedBytes_.load(std::memory_order_relaxed)) + sc.size > maxCachedBytes_)
+    {
+        ::operator delete(p);
+        return;
+    }
+    sc.free.push_back(p);
+    addRelaxed(cachedBytes_, sc.size);
+}
+
+// 整个周期都没用到的空闲块还给系统
+void BufferPool::trim()
+{
+    for (SizeClass &sc : classes_)
+    {
+        size_t n = std::min(sc.lowWater, sc.free.size());
+        for (size_t i = 0; i < n; ++i)
+        {
+            ::operator delete(sc.free.back());
+            sc.free.pop_back();
+        }
+        addRelaxed(cachedBytes_, -static_cast<int64_t>(n * sc.size));
+        if (sc.free.empty())
+        {
+            std::vector<void *>().swap(sc.free);
+        }
+        sc.lowWater = sc.free.size();
+    }
+}
+
+BufferPool::Stats BufferPool::stats() const
+{
+    Stats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.cachedBytes = cachedBytes_.load(std::memory_order_relaxed);
+    stats.inUseBytes = inUseBytes_.load(std::memory_order_relaxed) + foreignBytes_.load(std::memory_order_relaxed);
+    return stats;
+}
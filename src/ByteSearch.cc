@@ -0,0 +1,333 @@
+#include <string.h>
+
+#include "ByteSearch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BYTESEARCH_X86 1
+#endif
+
+namespace ByteSearch {
+
+namespace {
+
+// ---------------- 标量实现 ----------------
+
+const char *findByteScalar(const char *begin, const char *end, char c)
+{
+    return static_cast<const char *>(::memchr(begin, c, end - begin));
+}
+
+const char *findPairScalar(const char *begin, const char *end, char c0, char c1)
+{
+    for (const char *p = begin; end - p >= 2; ++p)
+    {
+        p = findByteScalar(p, end - 1, c0);
+        if (p == nullptr)
+        {
+            return nullptr;
+        }
+        if (p[1] == c1)
+        {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+const char *findSeqScalar(const char *begin, const char *end, const char *needle, size_t len)
+{
+    return static_cast<const char *>(::memmem(begin, end - begin, needle, len));
+}
+
+#ifdef BYTESEARCH_X86
+
+// ---------------- SSE2 x86_64的基线 不需要检查 ----------------
+
+const char *findByteSse2(const char *p, const char *end, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    for (; end - p >= 64; p += 64)
+    {
+        __m128i eq0 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), needle);
+        __m128i eq1 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16)), needle);
+        __m128i eq2 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 32)), needle);
+        __m128i eq3 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 48)), needle);
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(eq0, eq1), _mm_or_si128(eq2, eq3))) != 0)
+        {
+            break; // 命中在这64字节中 交给下面的循环定位
+        }
+    }
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    for (; p < end; ++p)
+    {
+        if (*p == c)
+        {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+// 同时比较p和p+1开始的两个块 两个掩码相与就是c0c1出现的位置
+const char *findPairSse2(const char *p, const char *end, char c0, char c1)
+{
+    const __m128i first = _mm_set1_epi8(c0);
+    const __m128i second = _mm_set1_epi8(c1);
+    for (; end - p >= 65; p += 64)
+    {
+        __m128i any = _mm_setzero_si128();
+        for (int i = 0; i < 64; i += 16)
+        {
+            __m128i eq0 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i)), first);
+            __m128i eq1 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i + 1)), second);
+            any = _mm_or_si128(any, _mm_and_si128(eq0, eq1));
+        }
+        if (_mm_movemask_epi8(any) != 0)
+        {
+            break;
+        }
+    }
+    for (; end - p >= 17; p += 16)
+    {
+        __m128i block0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i block1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block0, first))
+                 & _mm_movemask_epi8(_mm_cmpeq_epi8(block1, second));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return findPairScalar(p, end, c0, c1);
+}
+
+// 首字节和末字节都匹配的位置才逐个memcmp 大部分位置在向量比较中就被排除了
+const char *findSeqSse2(const char *p, const char *end, const char *needle, size_t len)
+{
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[len - 1]);
+    for (; end - p >= static_cast<ptrdiff_t>(len - 1 + 16); p += 16)
+    {
+        __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + len - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(blockFirst, first))
+                      & _mm_movemask_epi8(_mm_cmpeq_epi8(blockLast, last));
+        while (mask != 0)
+        {
+            int bit = __builtin_ctz(mask);
+            if (::memcmp(p + bit + 1, needle + 1, len - 2) == 0)
+            {
+                return p + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return findSeqScalar(p, end, needle, len);
+}
+
+// ---------------- AVX2 运行时检查CPUID后才会调用 ----------------
+
+// 一次处理4个块 四个比较结果合并后只判断一次 命中后再逐块定位 减少分支
+__attribute__((target("avx2")))
+const char *findByteAvx2(const char *p, const char *end, char c)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    for (; end - p >= 128; p += 128)
+    {
+        __m256i eq0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)), needle);
+        __m256i eq1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32)), needle);
+        __m256i eq2 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 64)), needle);
+        __m256i eq3 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 96)), needle);
+        __m256i any = _mm256_or_si256(_mm256_or_si256(eq0, eq1), _mm256_or_si256(eq2, eq3));
+        if (!_mm256_testz_si256(any, any))
+        {
+            break; // 命中在这128字节中 交给下面的循环定位
+        }
+    }
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return findByteSse2(p, end, c);
+}
+
+__attribute__((target("avx2")))
+const char *findPairAvx2(const char *p, const char *end, char c0, char c1)
+{
+    const __m256i first = _mm256_set1_epi8(c0);
+    const __m256i second = _mm256_set1_epi8(c1);
+    for (; end - p >= 129; p += 128)
+    {
+        __m256i any = _mm256_setzero_si256();
+        for (int i = 0; i < 128; i += 32)
+        {
+            __m256i eq0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i)), first);
+            __m256i eq1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i + 1)), second);
+            any = _mm256_or_si256(any, _mm256_and_si256(eq0, eq1));
+        }
+        if (!_mm256_testz_si256(any, any))
+        {
+            break;
+        }
+    }
+    for (; end - p >= 33; p += 32)
+    {
+        __m256i block0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i block1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block0, first))
+                      & _mm256_movemask_epi8(_mm256_cmpeq_epi8(block1, second));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return findPairSse2(p, end, c0, c1);
+}
+
+__attribute__((target("avx2")))
+const char *findSeqAvx2(const char *p, const char *end, const char *needle, size_t len)
+{
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[len - 1]);
+    for (; end - p >= static_cast<ptrdiff_t>(len - 1 + 32); p += 32)
+    {
+        __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + len - 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(blockFirst, first))
+                      & _mm256_movemask_epi8(_mm256_cmpeq_epi8(blockLast, last));
+        while (mask != 0)
+        {
+            int bit = __builtin_ctz(mask);
+            if (::memcmp(p + bit + 1, needle + 1, len - 2) == 0)
+            {
+                return p + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return findSeqSse2(p, end, needle, len);
+}
+
+#endif // BYTESEARCH_X86
+
+struct Impl
+{
+    Level level;
+    const char *(*findByte)(const char *, const char *, char);
+    const char *(*findPair)(const char *, const char *, char, char);
+    const char *(*findSeq)(const char *, const char *, const char *, size_t); // len >= 3
+};
+
+Level supportedLevel()
+{
+#ifdef BYTESEARCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return kAvx2;
+    }
+#if defined(__SSE2__)
+    return kSse2;
+#else
+    return __builtin_cpu_supports("sse2") ? kSse2 : kScalar;
+#endif
+#else
+    return kScalar;
+#endif
+}
+
+Impl makeImpl(Level level)
+{
+    switch (level)
+    {
+#ifdef BYTESEARCH_X86
+    case kAvx2:
+        return Impl{kAvx2, findByteAvx2, findPairAvx2, findSeqAvx2};
+    case kSse2:
+        return Impl{kSse2, findByteSse2, findPairSse2, findSeqSse2};
+#endif
+    default:
+        return Impl{kScalar, findByteScalar, findPairScalar, findSeqScalar};
+    }
+}
+
+// 第一次查找时按CPUID选择 之后只读
+Impl &impl()
+{
+    static Impl current = makeImpl(supportedLevel());
+    return current;
+}
+
+} // namespace
+
+const char *findByte(const char *begin, const char *end, char c)
+{
+    return begin < end ? impl().findByte(begin, end, c) : nullptr;
+}
+
+const char *findPair(const char *begin, const char *end, char c0, char c1)
+{
+    return end - begin >= 2 ? impl().findPair(begin, end, c0, c1) : nullptr;
+}
+
+const char *findSeq(const char *begin, const char *end, const char *needle, size_t len)
+{
+    if (len == 0)
+    {
+        return begin;
+    }
+    if (static_cast<size_t>(end - begin) < len)
+    {
+        return nullptr;
+    }
+    if (len == 1)
+    {
+        return impl().findByte(begin, end, needle[0]);
+    }
+    if (len == 2)
+    {
+        return impl().findPair(begin, end, needle[0], needle[1]);
+    }
+    return impl().findSeq(begin, end, needle, len);
+}
+
+Level level()
+{
+    return impl().level;
+}
+
+const char *levelName(Level level)
+{
+    switch (level)
+    {
+    case kAvx2:
+        return "avx2";
+    case kSse2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+Level setLevel(Level level)
+{
+    Level supported = supportedLevel();
+    impl() = makeImpl(level < supported ? level : supported);
+    return impl().level;
+}
+
+}
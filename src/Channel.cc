@@ -8,6 +8,7 @@
 const int Channel::kNoneEvent = 0;                          // 空事件（无感兴趣的事件）
 const int Channel::kReadEvent = EPOLLIN | EPOLLPRI;         // 读事件：EPOLLIN（普通数据可读）+ EPOLLPRI（紧急数据可读）
 const int Channel::kWriteEvent = EPOLLOUT;                  // 写事件：EPOLLOUT（数据可写）
+const int Channel::kEdgeTriggered = EPOLLET;                // 边缘触发：EPOLLET
 
 // Channel构造函数：初始化成员变量
 // 参数：loop_（所属的EventLoop）、fd_（封装的文件描述符）
@@ -17,6 +18,7 @@ Channel::Channel(EventLoop *loop, int fd)
     , events_(0)     // 初始化为空事件（默认不关注任何事件）
     , revents_(0)    // 初始化为空（实际发生的事件由Poller填充）
     , index_(-1)     // 初始化为-1（表示该Channel尚未注册到Poller中，用于Poller内部管理）
+    , edgeTriggered_(false) // 默认水平触发
     , tied_(false)   // 初始化为false（表示未绑定任何对象的生命周期）
 {
 }
@@ -105,7 +107,8 @@ void Channel::handleEventWithGuard(Timestamp receiveTime)
     }
 
     // 4. 处理写事件（EPOLLOUT：fd可写，如发送缓冲区有空闲空间）
-    if (revents_ & EPOLLOUT)
+    // ET模式下EPOLLOUT一直注册着 只有真正关注写事件时才回调
+    if ((revents_ & EPOLLOUT) && (!edgeTriggered_ || isWriting()))
     {
         if (writeCallback_)  // 若注册了写回调，执行回调
         {
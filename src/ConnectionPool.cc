@@ -0,0 +1,126 @@
+#include <new>
+
+#include "ConnectionPool.h"
+#include "CurrentThread.h"
+#include "TcpConnection.h"
+
+// allocate_shared的控制块(虚表指针、两个引用计数和分配器)不超过kControlBlockSlack字节
+// 取整到缓存行 相邻的块不会共享缓存行
+static const size_t kControlBlockSlack = 64;
+static const size_t kCacheLine = 64;
+
+const size_t ConnectionPool::kBlockSize =
+    (sizeof(TcpConnection) + kControlBlockSlack + kCacheLine - 1) / kCacheLine * kCacheLine;
+const size_t ConnectionPool::kDefaultMaxCached;
+
+ConnectionPool::ConnectionPool(pid_t threadId)
+    : threadId_(threadId)
+    , detached_(false)
+    , maxCached_(kDefaultMaxCached)
+    , hits_(0)
+    , misses_(0)
+    , cached_(0)
+    , inUse_(0)
+    , foreign_(0)
+{
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    for (void *p : free_)
+    {
+        ::operator delete(p);
+    }
+}
+
+bool ConnectionPool::inLoopThread() const
+{
+    return threadId_ == CurrentThread::tid() && !detached_.load(std::memory_order_acquire);
+}
+
+void *ConnectionPool::allocate(size_t size)
+{
+    if (size > kBlockSize)
+    {
+        // 标准库的控制块比预计的大 不进池 仍然可以正常使用
+        return ::operator new(size);
+    }
+    if (!inLoopThread())
+    {
+        // 冷路径 不碰空闲链表 仍按块大小申请 之后可能在loop线程中归还到空闲链表
+        foreign_.fetch_add(1, std::memory_order_relaxed);
+        return ::operator new(kBlockSize);
+    }
+
+    addRelaxed(inUse_, 1);
+    if (free_.empty())
+    {
+        addRelaxed(misses_, 1);
+        return ::operator new(kBlockSize);
+    }
+    void *p = free_.back();
+    free_.pop_back();
+    addRelaxed(hits_, 1);
+    addRelaxed(cached_, -1);
+    return p;
+}
+
+void ConnectionPool::deallocate(void *p, size_t size)
+{
+    if (size > kBlockSize)
+    {
+        ::operator delete(p);
+        return;
+    }
+    if (!inLoopThread())
+    {
+        foreign_.fetch_add(-1, std::memory_order_relaxed);
+        ::operator delete(p);
+        return;
+    }
+
+    addRelaxed(inUse_, -1);
+    if (free_.size() >= maxCached_)
+    {
+        ::operator delete(p);
+        return;
+    }
+    free_.push_back(p);
+    addRelaxed(cached_, 1);
+}
+
+void ConnectionPool::reserve(size_t n)
+{
+    if (maxCached_ < n)
+    {
+        maxCached_ = n;
+    }
+    free_.reserve(maxCached_);
+    while (free_.size() < n)
+    {
+        free_.push_back(::operator new(kBlockSize));
+        addRelaxed(cached_, 1);
+    }
+}
+
+ConnectionPool::Stats ConnectionPool::stats() const
+{
+    Stats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.cached = cached_.load(std::memory_order_relaxed);
+    stats.inUse = inUse_.load(std::memory_order_relaxed) + foreign_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void ConnectionPool::detach()
+{
+    for (void *p : free_)
+    {
+        ::operator delete(p);
+    }
+    addRelaxed(cached_, -static_cast<int64_t>(free_.size()));
+    free_.clear();
+    // 还在使用的块之后从任何线程归还都按其他线程处理 inUse_保持不变 由foreign_抵消
+    detached_.store(true, std::memory_order_release);
+}
@@ -2,14 +2,19 @@
 
 #include "Poller.h"
 #include "EPollPoller.h"
+#include "IoUringPoller.h"
 
-//由于只实现了 EPollPoller，所以这样实现
+//由于只实现了 EPollPoller 和 IoUringPoller，所以这样实现
 Poller *Poller::newDefaultPoller(EventLoop *loop)
 {
     if (::getenv("MUDUO_USE_POLL"))
     {
         return nullptr; // 生成poll的实例
     }
+    else if (::getenv("MUDUO_USE_IOURING") && IoUringPoller::isSupported())
+    {
+        return new IoUringPoller(loop); // 生成io_uring的实例 内核不支持时退回epoll
+    }
     else
     {
         return new EPollPoller(loop); // 生成epoll的实例
@@ -6,6 +6,21 @@
 #include <unistd.h>
 #include <string.h>
 #include <assert.h>
+#include <sys/ioctl.h>
+#include <linux/types.h>
+
+// 较老的内核头文件中没有epoll忙轮询的定义 按Linux 6.9的uapi补上
+#ifndef EPIOCSPARAMS
+struct epoll_params
+{
+    __u32 busy_poll_usecs;
+    __u16 busy_poll_budget;
+    __u8 prefer_busy_poll;
+    __u8 __pad;
+};
+#define EPOLL_IOC_TYPE 0x8A
+#define EPIOCSPARAMS _IOW(EPOLL_IOC_TYPE, 0x01, struct epoll_params)
+#endif
 
 const int kNew = -1;    // 某个channel还没添加至Poller          // channel的成员index_初始化为-1
 const int kAdded = 1;   // 某个channel已经添加至Poller
@@ -24,10 +39,25 @@ EPollPoller::~EPollPoller() {
     ::close(epollfd_);
 }
 
+bool EPollPoller::setBusyPoll(int usec) {
+    epoll_params params;
+    ::memset(&params, 0, sizeof(params));
+    params.busy_poll_usecs = usec;
+    params.busy_poll_budget = 8; // 非CAP_NET_ADMIN时内核允许的上限
+    params.prefer_busy_poll = 1;
+    if (::ioctl(epollfd_, EPIOCSPARAMS, &params) < 0) {
+        LOG_ERROR("EPollPoller::setBusyPoll ioctl error:%d\n", errno);
+        return false;
+    }
+    return true;
+}
+
 // 监听
 Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels) {
-    // 由于频繁调用poll 实际上应该用LOG_DEBUG输出日志更为合理 当遇到并发场景 关闭DEBUG日志提升效率
-    LOG_INFO("func=%s => fd total count:%lu\n", __FUNCTION__, channels_.size());
+    // 由于频繁调用poll 用LOG_DEBUG输出日志 忙轮询时每秒会poll上百万次
+    LOG_DEBUG("func=%s => fd total count:%lu\n", __FUNCTION__, numChannels());
+
+    flushUpdates();
 
     int numEvents = ::epoll_wait(epollfd_, &*events_.begin(), static_cast<int>(events_.size()), timeoutMs);
     int saveErrno = errno;
@@ -52,45 +82,80 @@ Timestamp EPollPoller::poll(int timeoutMs, ChannelList *activeChannels) {
     return now;
 }
 // 重写基类方法，更新 Channel 在 epoll 中的事件监控状态
+// 这里只记录变化 真正的epoll_ctl推迟到下一次poll()之前 由flushUpdates统一执行
 void EPollPoller::updateChannel(Channel *channel) {
     const int index = channel->index();
-    LOG_INFO("func=%s => fd=%d events=%d index=%d\n", __FUNCTION__, channel->fd(), channel->events(), index);
+    const int fd = channel->fd();
+    LOG_INFO("func=%s => fd=%d events=%d index=%d\n", __FUNCTION__, fd, channel->events(), index);
 
     if (index == kNew || index == kDeleted) {
         if (index == kNew) {
-            int fd = channel->fd();
-            channels_[fd] = channel;
+            addChannel(fd, channel);
         } else { // index == kDeleted
         } 
         channel->set_index(kAdded); // 将状态设置为“已添加”
-        update(EPOLL_CTL_ADD, channel); // 调用底层update函数，执行epoll_ctl ADD操作
     } else {
         // channel已经在Poller中注册过了
-        int fd = channel->fd();
         if (channel->isNoneEvent()) {
-            update(EPOLL_CTL_DEL, channel);
             channel->set_index(kDeleted);
         }
-        else {
-            update(EPOLL_CTL_MOD, channel);
-        }
+    }
+
+    if (static_cast<size_t>(fd) >= fdStates_.size()) {
+        FdState init = {kNotRegistered, false};
+        fdStates_.resize(fd + 1, init);
+    }
+    FdState &state = fdStates_[fd];
+    if (!state.dirty) {
+        state.dirty = true;
+        dirtyFds_.push_back(fd);
     }
 }
 // 重写基类方法，将 Channel 从 epoll 监控中移除
+// 删除之后fd马上可能被close 所以这里立即执行EPOLL_CTL_DEL 不推迟
 void EPollPoller::removeChannel(Channel *channel) {
     int fd = channel->fd();
-    channels_.erase(fd);
+    eraseChannel(fd);
 
     LOG_INFO("func=%s => fd=%d\n", __FUNCTION__, fd);
 
-    int index = channel->index();
-    if (index == kAdded)
-    {
-        update(EPOLL_CTL_DEL, channel);
+    if (static_cast<size_t>(fd) < fdStates_.size()) {
+        FdState &state = fdStates_[fd];
+        if (state.registered != kNotRegistered) {
+            update(EPOLL_CTL_DEL, channel, 0);
+            state.registered = kNotRegistered;
+        }
+        state.dirty = false; // 如果还在dirtyFds_中 flushUpdates时会跳过
     }
     channel->set_index(kNew);
 }
 
+void EPollPoller::flushUpdates() {
+    for (int fd : dirtyFds_) {
+        FdState &state = fdStates_[fd];
+        if (!state.dirty) {
+            continue;
+        }
+        state.dirty = false;
+
+        Channel *channel = findChannel(fd);
+        int desired = (channel != nullptr && channel->index() == kAdded) ? channel->events() : kNotRegistered;
+        if (desired == state.registered) {
+            continue; // 本轮内的修改相互抵消了 例如先enableWriting又disableWriting
+        }
+
+        if (state.registered == kNotRegistered) {
+            update(EPOLL_CTL_ADD, channel, desired);
+        } else if (desired == kNotRegistered) {
+            update(EPOLL_CTL_DEL, channel, 0);
+        } else {
+            update(EPOLL_CTL_MOD, channel, desired);
+        }
+        state.registered = desired;
+    }
+    dirtyFds_.clear();
+}
+
 
 // 核心辅助方法：将 epoll_wait 返回的就绪事件填充到 activeChannels（传出参数）
 // 填写活跃的连接
@@ -119,13 +184,13 @@ void EPollPoller::fillActiveChannels(int numEvents, ChannelList *activeChannels)
 }
 
 // 底层辅助方法：调用 epoll_ctl 执行 ADD/MOD/DEL 操作，更新 epoll 内部状态
-void EPollPoller::update(int operation, Channel *channel) {
+void EPollPoller::update(int operation, Channel *channel, int events) {
     epoll_event event; 
     ::memset(&event, 0, sizeof(event));
 
     int fd = channel->fd();
 
-    event.events = channel->events();
+    event.events = events;
     event.data.fd = fd;
     //这是最关键的一步！将 Channel 对象的指针存入 event.data.ptr 字段。
     // 当这个 fd 上有事件发生时，epoll_wait 会返回这个 event 结构体，
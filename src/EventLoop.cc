@@ -3,17 +3,25 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <memory>
+#include <time.h>
 
 #include "EventLoop.h"
 #include "Logger.h"
 #include "Channel.h"
 #include "Poller.h"
+#include "TimerQueue.h"
+#include "BufferPool.h"
+#include "ReceiveArena.h"
+#include "ConnectionPool.h"
+#include "ZeroCopyReaper.h"
 
 // 防止一个线程创建多个EventLoop
 __thread EventLoop *t_loopInThisThread = nullptr;
 
 // 定义默认的Poller IO复用接口的超时时间
 const int kPollTimeMs = 10000; // 10000毫秒 = 10秒钟
+// 析构时执行剩下的回调最多几轮 还在连接中的连接(如ET续读)可能一直排队 不能无限执行
+const int kMaxDrainRounds = 16;
 
 /* 创建线程之后主线程和子线程谁先运行是不确定的。
  * 通过一个eventfd在线程之间传递数据的好处是多个线程无需上锁就可以实现同步。
@@ -30,6 +38,20 @@ const int kPollTimeMs = 10000; // 10000毫秒 = 10秒钟
  *     eventfd还可以用于同亲缘关系的进程之间的通信。
  *     eventfd用于不同亲缘关系的进程之间通信的话需要把eventfd放在几个进程共享的共享内存中（没有测试过）。
  */
+// 单调时钟 微秒 用于忙轮询的计时和统计
+static int64_t monotonicMicros()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 累加统计值 只有loop线程写 不需要原子的读改写
+static void addRelaxed(std::atomic<int64_t> &counter, int64_t delta)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
 // 创建wakeupfd 用来notify唤醒subReactor处理新来的channel
 int createEventfd()
 {
@@ -47,8 +69,23 @@ EventLoop::EventLoop()
     , callingPendingFunctors_(false)
     , threadId_(CurrentThread::tid())
     , poller_(Poller::newDefaultPoller(this))
+    , timerQueue_(new TimerQueue(this))
+    , bufferPool_(new BufferPool(this))
+    , receiveArena_(new ReceiveArena(bufferPool_.get()))
+    , connectionPool_(std::make_shared<ConnectionPool>(threadId_))
+    , zeroCopyReaper_(new ZeroCopyReaper(this))
     , wakeupFd_(createEventfd())
     , wakeupChannel_(new Channel(this, wakeupFd_))
+    , numConnections_(0)
+    , pendingBytes_(0)
+    , cpu_(-1)
+    , numaNode_(-1)
+    , busyPollMicros_(0)
+    , socketBusyPollMicros_(0)
+    , spinMicros_(0)
+    , workMicros_(0)
+    , blockMicros_(0)
+    , spinPolls_(0)
 {
     LOG_DEBUG("EventLoop created %p in thread %d\n", this, threadId_);
     if (t_loopInThisThread)
@@ -67,9 +104,21 @@ EventLoop::EventLoop()
 }
 EventLoop::~EventLoop()
 {
+    /**
+     * loop()退出时队列中可能还有回调: 比如单线程时TcpServer在loop()返回之后析构 销毁连接的回调排在这里
+     * 或者subloop先收到quit 没来得及执行TcpServer析构时投递的connectDestroyed
+     * 直接丢弃的话连接释放self_的任务(见TcpConnection::connectDestroyed)不会执行 连接连同fd和缓冲区一起泄漏
+     * 在这里按顺序执行完 之前排队的捕获this的回调仍然排在释放任务的前面
+     **/
+    for (int round = 0; round < kMaxDrainRounds && !pendingFunctors_.empty(); ++round)
+    {
+        doPendingFunctors();
+    }
+
     wakeupChannel_->disableAll(); // 给Channel移除所有感兴趣的事件
     wakeupChannel_->remove();     // 把Channel从EventLoop上删除掉
     ::close(wakeupFd_);
+    connectionPool_->detach(); // 还没释放的连接之后归还时不再碰空闲链表
     t_loopInThisThread = nullptr;
 }
 
@@ -81,10 +130,23 @@ void EventLoop::loop()
 
     LOG_INFO("EventLoop %p start looping\n", this);
 
+    /**
+     * 忙轮询：有事件之后的busyPollMicros_微秒内用0超时poll空转 省掉阻塞/唤醒的延迟
+     * 空转超过预算仍没有事件 退回阻塞poll 再次有事件时重新开始空转
+     **/
+    bool spinning = busyPollMicros_ > 0;
+    int64_t lastWorkMicros = monotonicMicros();
+
     while (!quit_)
     {
         activeChannels_.clear();
-        pollRetureTime_ = poller_->poll(kPollTimeMs, &activeChannels_);
+        const bool busyPoll = busyPollMicros_ > 0;
+        const int timeoutMs = (busyPoll && spinning) ? 0 : kPollTimeMs;
+        const int64_t pollStart = busyPoll ? monotonicMicros() : 0;
+
+        pollRetureTime_ = poller_->poll(timeoutMs, &activeChannels_);
+        const int64_t pollEnd = busyPoll ? monotonicMicros() : 0;
+
         for (Channel *channel : activeChannels_)
         {
             // Poller监听哪些channel发生了事件 然后上报给EventLoop 通知channel处理相应的事件
@@ -97,6 +159,36 @@ void EventLoop::loop()
          * mainloop调用queueInLoop将回调加入subloop（该回调需要subloop执行 但subloop还在poller_->poll处阻塞） queueInLoop通过wakeup将subloop唤醒
          **/
         doPendingFunctors();
+
+        if (busyPoll)
+        {
+            const int64_t workEnd = monotonicMicros();
+            const bool idle = activeChannels_.empty();
+            if (timeoutMs != 0)
+            {
+                addRelaxed(blockMicros_, pollEnd - pollStart);
+                addRelaxed(workMicros_, workEnd - pollEnd);
+            }
+            else if (idle)
+            {
+                addRelaxed(spinMicros_, workEnd - pollStart); // 空转一整轮都算作空转时间
+                addRelaxed(spinPolls_, 1);
+            }
+            else
+            {
+                addRelaxed(workMicros_, workEnd - pollEnd);
+            }
+
+            if (!idle)
+            {
+                spinning = true;
+                lastWorkMicros = workEnd;
+            }
+            else if (spinning && workEnd - lastWorkMicros >= busyPollMicros_)
+            {
+                spinning = false; // 空转预算用完 退回阻塞
+            }
+        }
     }
     LOG_INFO("EventLoop %p stop looping.\n", this);
     looping_ = false;
@@ -131,29 +223,71 @@ void EventLoop::runInLoop(Functor cb)
     }
     else // 在非当前EventLoop线程中执行cb，就需要唤醒EventLoop所在线程执行cb
     {
-        queueInLoop(cb);
+        queueInLoop(std::move(cb));
     }
 }
 
 // 把cb放入队列中 唤醒loop所在的线程执行cb
 void EventLoop::queueInLoop(Functor cb)
 {
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        pendingFunctors_.emplace_back(cb);
-    }
+    bool wasEmpty = pendingFunctors_.push(std::move(cb));
 
     /**
      * || callingPendingFunctors的意思是 当前loop正在执行回调中 但是loop的pendingFunctors_中又加入了新的回调 需要通过wakeup写事件
      * 唤醒相应的需要执行上面回调操作的loop的线程 让loop()下一次poller_->poll()不再阻塞（阻塞的话会延迟前一次新加入的回调的执行），然后
      * 继续执行pendingFunctors_中的回调函数
+     *
+     * 队列原本非空说明已经有生产者唤醒过loop 或者是loop线程自己加入的(本轮末尾一定会执行) 不需要重复write eventfd
+     * loop()还没开始时loop线程自己加入的回调也要唤醒 否则之后其他线程的回调会被省掉唤醒 第一次poll会一直阻塞
      **/
-    if (!isInLoopThread() || callingPendingFunctors_)
+    if (wasEmpty && (!isInLoopThread() || callingPendingFunctors_ || !looping_))
     {
         wakeup(); // 唤醒loop所在线程
     }
 }
 
+void EventLoop::setBusyPoll(int spinMicros, int socketBusyPollMicros)
+{
+    busyPollMicros_ = spinMicros > 0 ? spinMicros : 0;
+    socketBusyPollMicros_ = socketBusyPollMicros > 0 ? socketBusyPollMicros : 0;
+    if (socketBusyPollMicros_ > 0 && !poller_->setBusyPoll(socketBusyPollMicros_))
+    {
+        LOG_ERROR("EventLoop::setBusyPoll poller busy poll unsupported, only socket SO_BUSY_POLL is used\n");
+    }
+}
+
+EventLoop::BusyPollStats EventLoop::busyPollStats() const
+{
+    BusyPollStats stats;
+    stats.spinMicros = spinMicros_.load(std::memory_order_relaxed);
+    stats.workMicros = workMicros_.load(std::memory_order_relaxed);
+    stats.blockMicros = blockMicros_.load(std::memory_order_relaxed);
+    stats.spinPolls = spinPolls_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+TimerId EventLoop::runAt(Timestamp time, TimerCallback cb)
+{
+    return timerQueue_->addTimer(std::move(cb), time, 0.0);
+}
+
+TimerId EventLoop::runAfter(double delay, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::now(), delay));
+    return runAt(time, std::move(cb));
+}
+
+TimerId EventLoop::runEvery(double interval, TimerCallback cb)
+{
+    Timestamp time(addTime(Timestamp::now(), interval));
+    return timerQueue_->addTimer(std::move(cb), time, interval);
+}
+
+void EventLoop::cancel(TimerId timerId)
+{
+    timerQueue_->cancel(timerId);
+}
+
 void EventLoop::handleRead()
 {
     uint64_t one = 1;
@@ -191,20 +325,19 @@ bool EventLoop::hasChannel(Channel *channel)
     return poller_->hasChannel(channel);
 }
 
+bool EventLoop::edgeTriggeredSupported() const
+{
+    return poller_->edgeTriggeredSupported();
+}
+
 void EventLoop::doPendingFunctors()
 {
-    std::vector<Functor> functors;
     callingPendingFunctors_ = true;
 
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        functors.swap(pendingFunctors_); // 交换的方式减少了锁的临界区范围 提升效率 同时避免了死锁 如果执行functor()在临界区内 且functor()中调用queueInLoop()就会产生死锁
-    }
-
-    for (const Functor &functor : functors)
-    {
+    // 一次性摘下当前队列中的所有回调 执行期间新加入的回调留到下一轮 与原来swap vector的语义相同
+    pendingFunctors_.consumeAll([](Functor &functor) {
         functor(); // 执行当前loop需要执行的回调操作
-    }
+    });
 
     callingPendingFunctors_ = false;
 }
\ No newline at end of file
@@ -1,5 +1,72 @@
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
 #include "EventLoopThread.h"
 #include "EventLoop.h"
+#include "Logger.h"
+
+// 把当前线程绑定到cpu上
+static bool bindCurrentThreadToCpu(int cpu)
+{
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    int ret = ::pthread_setaffinity_np(::pthread_self(), sizeof(cpuset), &cpuset);
+    if (ret != 0)
+    {
+        LOG_ERROR("pthread_setaffinity_np cpu:%d error:%d\n", cpu, ret);
+        return false;
+    }
+    return true;
+}
+
+// 通过 /sys/devices/system/cpu/cpuN/nodeM 查询cpu所在的NUMA节点 查不到返回-1
+static int numaNodeOfCpu(int cpu)
+{
+    char path[64];
+    snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = ::opendir(path);
+    if (dir == nullptr)
+    {
+        return -1;
+    }
+    int node = -1;
+    while (struct dirent *entry = ::readdir(dir))
+    {
+        if (::strncmp(entry->d_name, "node", 4) == 0)
+        {
+            node = ::atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    ::closedir(dir);
+    return node;
+}
+
+// 当前线程之后的内存分配优先落在node节点上 节点内存不足时内核会退到其他节点
+static bool preferNumaNode(int node)
+{
+    unsigned long nodemask[16] = {0}; // 最多1024个节点
+    if (node < 0 || node >= static_cast<int>(sizeof(nodemask) * 8))
+    {
+        return false;
+    }
+    nodemask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    if (::syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodemask, sizeof(nodemask) * 8) < 0)
+    {
+        LOG_ERROR("set_mempolicy node:%d error:%d\n", node, errno);
+        return false;
+    }
+    return true;
+}
 
 
 /*
@@ -8,13 +75,17 @@
 保存线程初始化回调 callback_：用于 EventLoop 启动前的自定义初始化。
 */
 EventLoopThread::EventLoopThread(const ThreadInitCallback &cb,
-                                 const std::string &name)
+                                 const std::string &name,
+                                 int cpu,
+                                 bool bindNumaMemory)
     : loop_(nullptr)
     , exiting_(false)
     , thread_(std::bind(&EventLoopThread::threadFunc, this), name)
     , mutex_()
     , cond_()
     , callback_(cb)
+    , cpu_(cpu)
+    , bindNumaMemory_(bindNumaMemory)
 { 
 }
 
@@ -45,7 +116,21 @@ EventLoop *EventLoopThread::startLoop()
 // 下面这个方法 是在单独的新线程里运行的
 void EventLoopThread::threadFunc()
 {
+    // 先绑核再创建EventLoop 这样EventLoop以及之后在该线程中分配的内存都在本地节点上
+    int cpu = -1;
+    int node = -1;
+    if (cpu_ >= 0 && bindCurrentThreadToCpu(cpu_))
+    {
+        cpu = cpu_;
+        node = numaNodeOfCpu(cpu);
+        if (bindNumaMemory_ && node >= 0)
+        {
+            preferNumaNode(node);
+        }
+    }
+
     EventLoop loop; // 创建一个独立的EventLoop对象 和上面的线程是一一对应的 级one loop per thread
+    loop.setPlacement(cpu, node); // ThreadInitCallback中可以通过loop->cpu()/numaNode()查看绑定情况
 
     // 初始化回调函数，如果有
     if (callback_)
@@ -1,16 +1,33 @@
 #include <memory>
+#include <algorithm>
+#include <string.h>
  
 #include "EventLoopThreadPool.h"
 #include "EventLoopThread.h"
+#include "EventLoop.h"
+#include "InetAddress.h"
 #include "Logger.h"
 
+// FNV-1a 32位哈希 结果在不同进程/平台上保持一致
+static uint32_t fnv1a(const void *data, size_t len, uint32_t hash = 2166136261u)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < len; ++i)
+    {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
 /*
 保存主循环 baseLoop_（主线程的 EventLoop，即 Main Reactor）。
 保存线程池名称 name_（用于调试日志，区分不同线程池）。
 初始化状态变量：started_（是否启动）设为 false，numThreads_（线程数）初始为 0，next_（轮询索引）初始为 0。
 */
 EventLoopThreadPool::EventLoopThreadPool(EventLoop *baseLoop, const std::string &nameArg)
-    : baseLoop_(baseLoop), name_(nameArg), started_(false), numThreads_(0), next_(0)
+    : baseLoop_(baseLoop), name_(nameArg), started_(false), numThreads_(0), next_(0), bindNumaMemory_(false)
+    , policy_(kRoundRobin), randomState_(2463534242u)
 {
 }
 
@@ -27,10 +44,15 @@ void EventLoopThreadPool::start(const ThreadInitCallback &cb)
     {
         char buf[name_.size() + 32];
         snprintf(buf, sizeof buf, "%s%d", name_.c_str(), i); // 生成线程名
-        EventLoopThread *t = new EventLoopThread(cb, buf); // 创建EventLoopThread
+        int cpu = cpus_.empty() ? -1 : cpus_[i % cpus_.size()];
+        EventLoopThread *t = new EventLoopThread(cb, buf, cpu, bindNumaMemory_); // 创建EventLoopThread
         threads_.push_back(std::unique_ptr<EventLoopThread>(t)); // 智能指针管理，避免泄漏
         loops_.push_back(t->startLoop()); // 底层创建线程 绑定一个新的EventLoop 并返回该loop的地址
     }
+    if (policy_ == kConsistentHash)
+    {
+        buildHashRing();
+    }
     // 单线程模式：线程数为 0，直接在 baseLoop_ 执行初始化回调
     if (numThreads_ == 0 && cb) // 整个服务端只有一个线程运行baseLoop
     {
@@ -63,6 +85,84 @@ EventLoop *EventLoopThreadPool::getNextLoop()
 
 
 
+EventLoop *EventLoopThreadPool::getNextLoop(const InetAddress &peerAddr)
+{
+    if (loops_.size() <= 1)
+    {
+        return getNextLoop();
+    }
+
+    switch (policy_)
+    {
+    case kLeastConnections:
+    case kLeastPendingBytes:
+    {
+        // 计数器由各subloop各自维护 这里只做relaxed读 读到的是近似值 足够用于均衡
+        // 从轮询位置开始找 负载相同时退化为轮询 避免总是选中第一个loop
+        size_t start = next_;
+        next_ = (next_ + 1) % loops_.size();
+        EventLoop *best = nullptr;
+        int64_t bestLoad = 0;
+        for (size_t i = 0; i < loops_.size(); ++i)
+        {
+            EventLoop *loop = loops_[(start + i) % loops_.size()];
+            int64_t load = policy_ == kLeastConnections ? loop->numConnections() : loop->pendingBytes();
+            if (best == nullptr || load < bestLoad)
+            {
+                best = loop;
+                bestLoad = load;
+            }
+        }
+        return best;
+    }
+    case kPowerOfTwoChoices:
+    {
+        EventLoop *a = loops_[nextRandom() % loops_.size()];
+        EventLoop *b = loops_[nextRandom() % loops_.size()];
+        return a->numConnections() <= b->numConnections() ? a : b;
+    }
+    case kConsistentHash:
+    {
+        in_addr_t ip = peerAddr.getSockAddr()->sin_addr.s_addr; // 只按IP哈希 同一客户端的端口每次都不同
+        uint32_t hash = fnv1a(&ip, sizeof ip);
+        auto it = std::lower_bound(hashRing_.begin(), hashRing_.end(),
+                                   std::make_pair(hash, static_cast<EventLoop *>(nullptr)));
+        if (it == hashRing_.end())
+        {
+            it = hashRing_.begin(); // 环绕到第一个节点
+        }
+        return it->second;
+    }
+    case kRoundRobin:
+    default:
+        return getNextLoop();
+    }
+}
+
+void EventLoopThreadPool::buildHashRing()
+{
+    hashRing_.clear();
+    for (size_t i = 0; i < loops_.size(); ++i)
+    {
+        for (int v = 0; v < kVirtualNodesPerLoop; ++v)
+        {
+            uint32_t key[2] = {static_cast<uint32_t>(i), static_cast<uint32_t>(v)};
+            hashRing_.push_back(std::make_pair(fnv1a(key, sizeof key), loops_[i]));
+        }
+    }
+    std::sort(hashRing_.begin(), hashRing_.end());
+}
+
+uint32_t EventLoopThreadPool::nextRandom()
+{
+    uint32_t x = randomState_;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    randomState_ = x;
+    return x;
+}
+
 std::vector<EventLoop *> EventLoopThreadPool::getAllLoops()
 {
     if (loops_.empty())
@@ -0,0 +1,335 @@
+#include "IoUringPoller.h"
+#include "Logger.h"
+#include "Channel.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <algorithm>
+
+const int kNew = -1;    // 某个channel还没添加至Poller
+const int kAdded = 1;   // 某个channel已经添加至Poller
+const int kDeleted = 2; // 某个channel已经从Poller删除
+
+// glibc没有封装io_uring 直接走系统调用
+static int sys_io_uring_setup(unsigned entries, io_uring_params *p)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int sys_io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete,
+                              unsigned flags, const void *arg, size_t argsz)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argsz));
+}
+
+static uint64_t makeUserData(int fd, uint32_t generation)
+{
+    return (static_cast<uint64_t>(fd) << 32) | generation;
+}
+
+bool IoUringPoller::isSupported()
+{
+    io_uring_params params;
+    ::memset(&params, 0, sizeof params);
+    int fd = sys_io_uring_setup(2, &params);
+    if (fd < 0)
+    {
+        return false;
+    }
+    ::close(fd);
+    // NODROP保证CQ满时事件不丢失 EXT_ARG用于带超时的等待
+    return (params.features & IORING_FEAT_NODROP) && (params.features & IORING_FEAT_EXT_ARG);
+}
+
+IoUringPoller::IoUringPoller(EventLoop *loop)
+    : Poller(loop)
+    , ringfd_(-1)
+    , sqRingPtr_(MAP_FAILED)
+    , sqRingSize_(0)
+    , sqes_(static_cast<io_uring_sqe *>(MAP_FAILED))
+    , sqesSize_(0)
+    , sqeTail_(0)
+    , toSubmit_(0)
+    , cqRingPtr_(MAP_FAILED)
+    , cqRingSize_(0)
+{
+    io_uring_params params;
+    ::memset(&params, 0, sizeof params);
+    ringfd_ = sys_io_uring_setup(kRingEntries, &params);
+    if (ringfd_ < 0)
+    {
+        LOG_FATAL("io_uring_setup error:%d\n", errno);
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap)
+    {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+
+    sqRingPtr_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_SQ_RING);
+    if (sqRingPtr_ == MAP_FAILED)
+    {
+        LOG_FATAL("io_uring mmap sq ring error:%d\n", errno);
+    }
+    if (singleMmap)
+    {
+        cqRingPtr_ = sqRingPtr_;
+    }
+    else
+    {
+        cqRingPtr_ = ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_CQ_RING);
+        if (cqRingPtr_ == MAP_FAILED)
+        {
+            LOG_FATAL("io_uring mmap cq ring error:%d\n", errno);
+        }
+    }
+
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe *>(::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                                               MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED)
+    {
+        LOG_FATAL("io_uring mmap sqes error:%d\n", errno);
+    }
+
+    char *sq = static_cast<char *>(sqRingPtr_);
+    sqHead_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqEntries_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_entries);
+    sqArray_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqeTail_ = *sqTail_;
+
+    char *cq = static_cast<char *>(cqRingPtr_);
+    cqHead_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+}
+
+IoUringPoller::~IoUringPoller()
+{
+    ::munmap(sqes_, sqesSize_);
+    if (cqRingPtr_ != sqRingPtr_)
+    {
+        ::munmap(cqRingPtr_, cqRingSize_);
+    }
+    ::munmap(sqRingPtr_, sqRingSize_);
+    ::close(ringfd_);
+}
+
+Timestamp IoUringPoller::poll(int timeoutMs, ChannelList *activeChannels)
+{
+    LOG_DEBUG("func=%s => fd total count:%lu\n", __FUNCTION__, numChannels());
+
+    // 上一轮触发过的channel 如果仍然注册且没有被重新挂载 按当前关注的事件重新挂载 相当于LT模式
+    for (int fd : rearmFds_)
+    {
+        Channel *channel = findChannel(fd);
+        if (channel != nullptr && channel->index() == kAdded)
+        {
+            PollState &state = states_[fd];
+            if (!state.armed)
+            {
+                arm(channel, state);
+            }
+        }
+    }
+    rearmFds_.clear();
+
+    // 提交所有sqe并等待 只有这一次系统调用
+    int ret = enter(1, timeoutMs);
+    int saveErrno = errno;
+    Timestamp now(Timestamp::now());
+
+    if (ret < 0 && saveErrno != ETIME && saveErrno != EINTR)
+    {
+        errno = saveErrno;
+        LOG_ERROR("IoUringPoller::poll() error:%d", saveErrno);
+    }
+
+    size_t numBefore = activeChannels->size();
+    fillActiveChannels(activeChannels);
+    if (activeChannels->size() > numBefore)
+    {
+        LOG_INFO("%lu events happend\n", activeChannels->size() - numBefore);
+    }
+    else
+    {
+        LOG_DEBUG("%s timeout!\n", __FUNCTION__);
+    }
+    return now;
+}
+
+void IoUringPoller::updateChannel(Channel *channel)
+{
+    const int index = channel->index();
+    const int fd = channel->fd();
+    LOG_INFO("func=%s => fd=%d events=%d index=%d\n", __FUNCTION__, fd, channel->events(), index);
+
+    PollState &state = states_[fd];
+    if (index == kNew || index == kDeleted)
+    {
+        if (index == kNew)
+        {
+            addChannel(fd, channel);
+        }
+        channel->set_index(kAdded);
+        if (state.armed)
+        {
+            disarm(fd, state);
+        }
+        arm(channel, state);
+    }
+    else
+    {
+        if (channel->isNoneEvent())
+        {
+            if (state.armed)
+            {
+                disarm(fd, state);
+            }
+            channel->set_index(kDeleted);
+        }
+        else if (state.armed)
+        {
+            // 关注的事件变了 撤掉旧的poll请求重新挂载
+            disarm(fd, state);
+            arm(channel, state);
+        }
+        // 没有挂载说明刚触发过 在rearmFds_中 下一次poll()会按新的事件重新挂载
+    }
+}
+
+void IoUringPoller::removeChannel(Channel *channel)
+{
+    int fd = channel->fd();
+    eraseChannel(fd);
+
+    LOG_INFO("func=%s => fd=%d\n", __FUNCTION__, fd);
+
+    std::unordered_map<int, PollState>::iterator it = states_.find(fd);
+    if (it != states_.end() && it->second.armed)
+    {
+        disarm(fd, it->second);
+    }
+    channel->set_index(kNew);
+}
+
+io_uring_sqe *IoUringPoller::getSqe()
+{
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqeTail_ - head >= sqEntries_)
+    {
+        // SQ满了 先把已有的sqe提交掉 不等待完成事件
+        enter(0, 0);
+        head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        if (sqeTail_ - head >= sqEntries_)
+        {
+            LOG_FATAL("io_uring submission queue overflow\n");
+        }
+    }
+    unsigned index = sqeTail_ & sqMask_;
+    io_uring_sqe *sqe = &sqes_[index];
+    ::memset(sqe, 0, sizeof(*sqe));
+    sqArray_[index] = index;
+    ++sqeTail_;
+    ++toSubmit_;
+    return sqe;
+}
+
+void IoUringPoller::arm(Channel *channel, PollState &state)
+{
+    ++state.generation;
+    state.armed = true;
+
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = channel->fd();
+    // EPOLLIN/EPOLLPRI/EPOLLOUT与POLLIN/POLLPRI/POLLOUT的取值相同 可以直接使用
+    sqe->poll32_events = static_cast<uint32_t>(channel->events());
+    sqe->user_data = makeUserData(channel->fd(), state.generation);
+}
+
+void IoUringPoller::disarm(int fd, PollState &state)
+{
+    state.armed = false;
+
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = makeUserData(fd, state.generation);
+    sqe->user_data = kRemoveUserData;
+}
+
+int IoUringPoller::enter(unsigned minComplete, int timeoutMs)
+{
+    __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+
+    unsigned flags = 0;
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    ::memset(&arg, 0, sizeof arg);
+    if (minComplete > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if (timeoutMs >= 0)
+        {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+    }
+
+    int ret = sys_io_uring_enter(ringfd_, toSubmit_, minComplete, flags,
+                                 minComplete > 0 ? &arg : nullptr,
+                                 minComplete > 0 ? sizeof arg : 0);
+    if (ret >= 0)
+    {
+        toSubmit_ -= static_cast<unsigned>(ret);
+    }
+    return ret;
+}
+
+void IoUringPoller::fillActiveChannels(ChannelList *activeChannels)
+{
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+        const io_uring_cqe &cqe = cqes_[head & cqMask_];
+        if (cqe.user_data == kRemoveUserData)
+        {
+            continue;
+        }
+
+        int fd = static_cast<int>(cqe.user_data >> 32);
+        uint32_t generation = static_cast<uint32_t>(cqe.user_data);
+        std::unordered_map<int, PollState>::iterator it = states_.find(fd);
+        // generation不匹配说明是已经被撤销或替换的旧请求
+        if (it == states_.end() || !it->second.armed || it->second.generation != generation)
+        {
+            continue;
+        }
+        it->second.armed = false;
+        rearmFds_.push_back(fd);
+
+        Channel *channel = findChannel(fd);
+        if (cqe.res <= 0 || channel == nullptr)
+        {
+            continue; // 被取消或出错 下一轮重新挂载即可
+        }
+        // 一次性poll请求每轮每个fd至多产生一个完成事件 不需要去重
+        channel->set_revents(cqe.res);
+        activeChannels->push_back(channel);
+    }
+    __atomic_store_n(cqHead_, tail, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,78 @@
+#include <string.h>
+#include <endian.h>
+
+#include "LengthHeaderCodec.h"
+#include "TcpConnection.h"
+#include "Buffer.h"
+#include "Logger.h"
+
+const size_t LengthHeaderCodec::kHeaderLength;
+const size_t LengthHeaderCodec::kDefaultMaxFrameLength;
+
+LengthHeaderCodec::LengthHeaderCodec(const FramesCallback &cb, size_t maxFrameLength)
+    : framesCallback_(cb)
+    , maxFrameLength_(maxFrameLength)
+{
+}
+
+void LengthHeaderCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    const size_t readable = buf->readableBytes();
+    if (readable < kHeaderLength)
+    {
+        return;
+    }
+
+    // 每个loop线程一个 在多次调用之间复用 不用每次可读事件都分配
+    static thread_local std::vector<Frame> frames;
+    const char *base = buf->peek();
+    size_t offset = 0;
+    bool invalid = false;
+    while (readable - offset >= kHeaderLength)
+    {
+        uint32_t be;
+        ::memcpy(&be, base + offset, sizeof be);
+        const int32_t len = static_cast<int32_t>(be32toh(be));
+        if (len < 0 || static_cast<size_t>(len) > maxFrameLength_)
+        {
+            LOG_ERROR("LengthHeaderCodec::onMessage [%s] invalid length %d\n", conn->name().c_str(), len);
+            invalid = true;
+            break;
+        }
+        if (readable - offset - kHeaderLength < static_cast<size_t>(len))
+        {
+            break; // 最后一帧还没收全
+        }
+        frames.push_back(Frame(base + offset + kHeaderLength, len));
+        offset += kHeaderLength + len;
+    }
+
+    if (!frames.empty())
+    {
+        framesCallback_(conn, frames, receiveTime);
+        frames.clear();
+    }
+    if (invalid)
+    {
+        // 之后的数据无法再分帧 直接关闭 shutdown只关闭写端 还会继续读入并报错
+        buf->retrieveAll();
+        conn->forceClose();
+    }
+    else
+    {
+        buf->retrieve(offset);
+    }
+}
+
+void LengthHeaderCodec::send(const TcpConnectionPtr &conn, Buffer *buf) const
+{
+    buf->prependInt32(static_cast<int32_t>(buf->readableBytes()));
+    conn->send(buf);
+}
+
+void LengthHeaderCodec::send(const TcpConnectionPtr &conn, const char *data, size_t len) const
+{
+    Buffer buf(len);
+    buf.append(data, len);
+    send(conn, &buf);
+}
@@ -2,12 +2,34 @@
 #include "Channel.h"
 
 Poller::Poller(EventLoop *loop)
-    : ownerLoop_(loop)
+    : numChannels_(0)
+    , ownerLoop_(loop)
 {
 }
 
 bool Poller::hasChannel(Channel *channel) const
 {
-    auto it = channels_.find(channel->fd());
-    return it != channels_.end() && it->second == channel;
-}
\ No newline at end of file
+    return findChannel(channel->fd()) == channel;
+}
+
+void Poller::addChannel(int fd, Channel *channel)
+{
+    if (static_cast<size_t>(fd) >= channels_.size())
+    {
+        channels_.resize(fd + 1, nullptr);
+    }
+    if (channels_[fd] == nullptr)
+    {
+        ++numChannels_;
+    }
+    channels_[fd] = channel;
+}
+
+void Poller::eraseChannel(int fd)
+{
+    if (static_cast<size_t>(fd) < channels_.size() && channels_[fd] != nullptr)
+    {
+        channels_[fd] = nullptr;
+        --numChannels_;
+    }
+}
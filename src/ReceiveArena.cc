@@ -0,0 +1,76 @@
+#include <algorithm>
+
+#include "ReceiveArena.h"
+#include "BufferPool.h"
+
+const size_t ReceiveArena::kMinSize;
+const size_t ReceiveArena::kMaxSize;
+const int ReceiveArena::kWindow;
+
+ReceiveArena::ReceiveArena(BufferPool *pool)
+    : pool_(pool)
+    , data_(nullptr)
+    , capacity_(64 * 1024) // 与原来的栈上extrabuf一样大
+    , windowMax_(0)
+    , windowReads_(0)
+{
+}
+
+ReceiveArena::~ReceiveArena()
+{
+    if (data_)
+    {
+        PoolAllocator<char>(pool_).deallocate(data_, capacity_);
+    }
+}
+
+char *ReceiveArena::data()
+{
+    if (!data_)
+    {
+        data_ = PoolAllocator<char>(pool_).allocate(capacity_);
+    }
+    return data_;
+}
+
+char *ReceiveArena::release()
+{
+    char *data = data_;
+    data_ = nullptr;
+    return data;
+}
+
+void ReceiveArena::record(size_t used)
+{
+    if (used >= capacity_ && capacity_ < kMaxSize)
+    {
+        resize(capacity_ * 2); // 接收区被填满 socket里还有数据
+        return;
+    }
+
+    windowMax_ = std::max(windowMax_, used);
+    if (++windowReads_ == kWindow)
+    {
+        if (windowMax_ < capacity_ / 4 && capacity_ > kMinSize)
+        {
+            resize(std::max(capacity_ / 2, kMinSize));
+        }
+        else
+        {
+            windowMax_ = 0;
+            windowReads_ = 0;
+        }
+    }
+}
+
+void ReceiveArena::resize(size_t capacity)
+{
+    if (data_)
+    {
+        PoolAllocator<char>(pool_).deallocate(data_, capacity_);
+        data_ = nullptr;
+    }
+    capacity_ = capacity;
+    windowMax_ = 0;
+    windowReads_ = 0;
+}
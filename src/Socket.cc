@@ -2,6 +2,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <string.h>
+#include <errno.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
 
@@ -83,6 +84,29 @@ void Socket::setReusePort(bool on)
     ::setsockopt(sockfd_, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval));
 }
 
+void Socket::setBusyPoll(int usec)
+{
+    // SO_BUSY_POLL 让阻塞读/poll在没有数据时先忙轮询网卡队列usec微秒 降低延迟
+    // 超过net.core.busy_read需要CAP_NET_ADMIN
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0)
+    {
+        LOG_ERROR("setBusyPoll sockfd:%d error:%d\n", sockfd_, errno);
+    }
+}
+
+bool Socket::setZeroCopy(bool on)
+{
+    // SO_ZEROCOPY 允许send带MSG_ZEROCOPY标志 内核直接引用用户页 发送完成后通过错误队列通知
+    // 需要4.14以上的内核
+    int optval = on ? 1 : 0;
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &optval, sizeof(optval)) < 0)
+    {
+        LOG_ERROR("setZeroCopy sockfd:%d error:%d\n", sockfd_, errno);
+        return false;
+    }
+    return true;
+}
+
 void Socket::setKeepAlive(bool on)
 {
     // SO_KEEPALIVE 启用在已连接的套接字上定期传输消息。
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <functional>
+
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "ConnectionPool.h"
+#include "Logger.h"
+
+static EventLoop *CheckLoopNotNull(EventLoop *loop)
+{
+    if (loop == nullptr)
+    {
+        LOG_FATAL("%s:%s:%d client loop is null!\n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    return loop;
+}
+
+static InetAddress getLocalAddr(int sockfd)
+{
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    socklen_t addrlen = sizeof addr;
+    if (::getsockname(sockfd, (sockaddr *)&addr, &addrlen) < 0)
+    {
+        LOG_ERROR("sockets::getLocalAddr");
+    }
+    return InetAddress(addr);
+}
+
+static InetAddress getPeerAddr(int sockfd)
+{
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    socklen_t addrlen = sizeof addr;
+    if (::getpeername(sockfd, (sockaddr *)&addr, &addrlen) < 0)
+    {
+        LOG_ERROR("sockets::getPeerAddr");
+    }
+    return InetAddress(addr);
+}
+
+TcpClient::TcpClient(EventLoop *loop, const InetAddress &serverAddr, const std::string &nameArg)
+    : loop_(CheckLoopNotNull(loop))
+    , connector_(new Connector(loop, serverAddr))
+    , name_(nameArg)
+    , retry_(false)
+    , connect_(false)
+    , nextConnId_(1)
+{
+    connector_->setNewConnectionCallback(
+        std::bind(&TcpClient::newConnection, this, std::placeholders::_1));
+    LOG_INFO("TcpClient::TcpClient[%s] - connector %p\n", name_.c_str(), connector_.get());
+}
+
+TcpClient::~TcpClient()
+{
+    LOG_INFO("TcpClient::~TcpClient[%s] - connector %p\n", name_.c_str(), connector_.get());
+    TcpConnectionPtr conn;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        conn = connection_;
+    }
+    if (conn)
+    {
+        // 连接比TcpClient活得久 关闭回调不能再指向this 改为直接在loop中销毁连接
+        EventLoop *loop = loop_;
+        loop_->runInLoop([conn, loop]() {
+            conn->setCloseCallback([loop](const TcpConnectionPtr &connection) {
+                loop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, connection));
+            });
+        });
+        conn->forceClose();
+    }
+    // Connector由排队的任务持有 连接结果不再回调到this
+    connector_->stop();
+}
+
+void TcpClient::connect()
+{
+    LOG_INFO("TcpClient::connect[%s] - connecting to %s\n", name_.c_str(),
+             connector_->serverAddress().toIpPort().c_str());
+    connect_ = true;
+    // 已经有连接时不再重复连接 connection_只在loop线程中修改 这里读取不用加锁
+    loop_->runInLoop([this]() {
+        if (!connection_)
+        {
+            connector_->start();
+        }
+    });
+}
+
+void TcpClient::disconnect()
+{
+    connect_ = false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (connection_)
+    {
+        connection_->shutdown();
+    }
+}
+
+void TcpClient::stop()
+{
+    connect_ = false;
+    connector_->stop();
+}
+
+void TcpClient::newConnection(int sockfd)
+{
+    InetAddress peerAddr(getPeerAddr(sockfd));
+    char buf[32];
+    snprintf(buf, sizeof buf, ":%s#%d", peerAddr.toIpPort().c_str(), nextConnId_);
+    ++nextConnId_;
+    std::string connName = name_ + buf;
+
+    // 与TcpServer一样从本loop的连接池分配 创建者计入loop的连接数 connectDestroyed中减去
+    loop_->addConnections(1);
+    TcpConnectionPtr conn = std::allocate_shared<TcpConnection>(
+        ConnectionAllocator<TcpConnection>(loop_->connectionPool()),
+        loop_, connName, sockfd, getLocalAddr(sockfd), peerAddr);
+    conn->setConnectionCallback(connectionCallback_);
+    conn->setMessageCallback(messageCallback_);
+    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setCloseCallback(
+        [this](const TcpConnectionPtr &connection) { removeConnection(connection); });
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connection_ = conn;
+    }
+    conn->connectEstablished();
+}
+
+void TcpClient::removeConnection(const TcpConnectionPtr &conn)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connection_.reset();
+    }
+    loop_->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    if (retry_ && connect_)
+    {
+        LOG_INFO("TcpClient::connect[%s] - reconnecting to %s\n", name_.c_str(),
+                 connector_->serverAddress().toIpPort().c_str());
+        connector_->restart();
+    }
+}
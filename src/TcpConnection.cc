@@ -1,5 +1,6 @@
 #include <functional>
 #include <string>
+#include <algorithm>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -8,12 +9,15 @@
 #include <sys/sendfile.h>
 #include <fcntl.h> // for open
 #include <unistd.h> // for close
+#include <netinet/in.h>
 
 #include "TcpConnection.h"
 #include "Logger.h"
 #include "Socket.h"
 #include "Channel.h"
 #include "EventLoop.h"
+#include "SlotMap.h"
+#include "ZeroCopyReaper.h"
 
 static EventLoop *CheckLoopNotNull(EventLoop *loop)
 {
@@ -24,38 +28,87 @@ static EventLoop *CheckLoopNotNull(EventLoop *loop)
     return loop;
 }
 
+const size_t TcpConnection::kDefaultZeroCopyThreshold;
+
 TcpConnection::TcpConnection(EventLoop *loop,
                              const std::string &nameArg,
                              int sockfd,
                              const InetAddress &localAddr,
                              const InetAddress &peerAddr)
+    : TcpConnection(loop, std::shared_ptr<const std::string>(), sockfd, localAddr, peerAddr)
+{
+    name_ = nameArg;
+}
+
+TcpConnection::TcpConnection(EventLoop *loop,
+                             const std::shared_ptr<const std::string> &namePrefix,
+                             int sockfd,
+                             const InetAddress &localAddr,
+                             const InetAddress &peerAddr)
     : loop_(CheckLoopNotNull(loop))
-    , name_(nameArg)
+    , namePrefix_(namePrefix)
+    , id_(0)
     , state_(kConnecting)
     , reading_(true)
-    , socket_(new Socket(sockfd))
-    , channel_(new Channel(loop, sockfd))
+    , readPauses_(0)
+    , socket_(sockfd)
+    , channel_(loop, sockfd)
     , localAddr_(localAddr)
     , peerAddr_(peerAddr)
     , highWaterMark_(64 * 1024 * 1024) // 64M
+    , lowWaterMark_(0)
+    , aboveHighWater_(false)
+    , backpressure_(false)
+    , backpressureHigh_(0)
+    , backpressureLow_(0)
+    , throttled_(false)
+    , ioBudget_(0)
+    , corked_(false)
+    , flushQueued_(false)
+    , zeroCopyThreshold_(0)
+    , zeroCopySeq_(0)
+    , inputBuffer_(loop->bufferPool())
+    , outputBuffer_(loop->bufferPool())
 {
     // 下面给channel设置相应的回调函数 poller给channel通知感兴趣的事件发生了 channel会回调相应的回调函数
-    channel_->setReadCallback(
-        std::bind(&TcpConnection::handleRead, this, std::placeholders::_1));
-    channel_->setWriteCallback(
-        std::bind(&TcpConnection::handleWrite, this));
-    channel_->setCloseCallback(
-        std::bind(&TcpConnection::handleClose, this));
-    channel_->setErrorCallback(
-        std::bind(&TcpConnection::handleError, this));
+    // 只捕获this的lambda 放在InlineFunction的内联存储中 不需要单独分配
+    channel_.setReadCallback(
+        [this](Timestamp receiveTime) { handleRead(receiveTime); });
+    channel_.setWriteCallback(
+        [this]() { handleWrite(); });
+    channel_.setCloseCallback(
+        [this]() { handleClose(); });
+    channel_.setErrorCallback(
+        [this]() { handleError(); });
 
-    LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_.c_str(), sockfd);
-    socket_->setKeepAlive(true);
+    LOG_INFO("TcpConnection::ctor at fd=%d\n", sockfd);
+    socket_.setKeepAlive(true);
 }
 
 TcpConnection::~TcpConnection()
 {
-    LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d\n", name_.c_str(), channel_->fd(), (int)state_);
+    if (namePrefix_)
+    {
+        // 日志直接打印ID的各部分 不为了析构日志生成名字
+        LOG_INFO("TcpConnection::dtor[%s%u.%u.%u] at fd=%d state=%d\n", namePrefix_->c_str(),
+                 SlotId::tag(id_), SlotId::index(id_), SlotId::generation(id_), channel_.fd(), (int)state_);
+    }
+    else
+    {
+        LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d\n", name_.c_str(), channel_.fd(), (int)state_);
+    }
+}
+
+const std::string &TcpConnection::name() const
+{
+    std::call_once(nameOnce_, [this]() {
+        if (namePrefix_)
+        {
+            name_ = *namePrefix_ + std::to_string(SlotId::tag(id_)) + "." + std::to_string(SlotId::index(id_))
+                  + "." + std::to_string(SlotId::generation(id_));
+        }
+    });
+    return name_;
 }
 
 void TcpConnection::send(const std::string &buf)
@@ -68,53 +121,76 @@ void TcpConnection::send(const std::string &buf)
         }
         else
         {
+            // buf在调用返回后可能已经失效 拷贝一份交给loop线程
             loop_->runInLoop(
-                std::bind(&TcpConnection::sendInLoop, this, buf.c_str(), buf.size()));
+                std::bind(&TcpConnection::sendSliceInLoop, shared_from_this(), Slice::copyFrom(buf.data(), buf.size())));
         }
     }
 }
 
-/**
- * 发送数据 应用写的快 而内核发送数据慢 需要把待发送数据写入缓冲区，而且设置了水位回调
- **/
-void TcpConnection::sendInLoop(const void *data, size_t len)
+void TcpConnection::send(std::string &&message)
 {
-    ssize_t nwrote = 0;
-    size_t remaining = len;
-    bool faultError = false;
+    if (state_ == kConnected)
+    {
+        if (loop_->isInLoopThread())
+        {
+            sendStringInLoop(message);
+        }
+        else
+        {
+            loop_->runInLoop(
+                std::bind(&TcpConnection::sendSliceInLoop, shared_from_this(), Slice(std::move(message))));
+        }
+    }
+}
 
-    if (state_ == kDisconnected) // 之前调用过该connection的shutdown 不能再进行发送了
+void TcpConnection::send(Buffer *buf)
+{
+    if (state_ == kConnected)
     {
-        LOG_ERROR("disconnected, give up writing");
+        if (loop_->isInLoopThread())
+        {
+            sendBufferInLoop(buf);
+        }
+        else
+        {
+            // buf属于调用者 取出数据交给loop线程
+            loop_->runInLoop(
+                std::bind(&TcpConnection::sendSliceInLoop, shared_from_this(), Slice(buf->retrieveAllAsString())));
+        }
     }
+}
 
-    // 表示channel_第一次开始写数据或者缓冲区没有待发送数据
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+void TcpConnection::send(const Slice &slice)
+{
+    if (state_ == kConnected)
     {
-        nwrote = ::write(channel_->fd(), data, len);
-        if (nwrote >= 0)
+        if (loop_->isInLoopThread())
         {
-            remaining = len - nwrote;
-            if (remaining == 0 && writeCompleteCallback_)
-            {
-                // 既然在这里数据全部发送完成，就不用再给channel设置epollout事件了
-                loop_->queueInLoop(
-                    std::bind(writeCompleteCallback_, shared_from_this()));
-            }
+            sendSliceInLoop(slice);
         }
-        else // nwrote < 0
+        else
         {
-            nwrote = 0;
-            if (errno != EWOULDBLOCK) // EWOULDBLOCK表示非阻塞情况下没有数据后的正常返回 等同于EAGAIN
-            {
-                LOG_ERROR("TcpConnection::sendInLoop");
-                if (errno == EPIPE || errno == ECONNRESET) // SIGPIPE RESET
-                {
-                    faultError = true;
-                }
-            }
+            // 没有持有者的Slice在调用返回后可能已经失效 和send(const std::string &)一样拷贝一份
+            loop_->runInLoop(
+                std::bind(&TcpConnection::sendSliceInLoop, shared_from_this(),
+                          slice.holder() ? slice : Slice::copyFrom(slice.data(), slice.size())));
         }
     }
+}
+
+/**
+ * 发送数据 应用写的快 而内核发送数据慢 需要把待发送数据写入缓冲区，而且设置了水位回调
+ **/
+void TcpConnection::sendInLoop(const void *data, size_t len)
+{
+    if (state_ == kDisconnected) // 连接已经关闭(其他线程投递的send排在connectDestroyed之后) 不能再发送 也不能再排队
+    {
+        LOG_ERROR("disconnected, give up writing");
+        return;
+    }
+    bool faultError = false;
+    size_t nwrote = writeIfIdle(data, len, &faultError);
     /**
      * 说明当前这一次write并没有把数据全部发送出去 剩余的数据需要保存到缓冲区当中
      * 然后给channel注册EPOLLOUT事件，Poller发现tcp的发送缓冲区有空间后会通知
@@ -122,23 +198,455 @@ void TcpConnection::sendInLoop(const void *data, size_t len)
      * channel的writeCallback_实际上就是TcpConnection设置的handleWrite回调，
      * 把发送缓冲区outputBuffer_的内容全部发送完成
      **/
+    size_t remaining = len - nwrote;
     if (!faultError && remaining > 0)
     {
         // 目前发送缓冲区剩余的待发送的数据的长度
         size_t oldLen = outputBuffer_.readableBytes();
-        if (oldLen + remaining >= highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_)
+        outputBuffer_.append((char *)data + nwrote, remaining);
+        queuedOutput(oldLen, remaining);
+    }
+}
+
+// 和sendInLoop一样 剩下的数据较多时接管message按引用排队
+void TcpConnection::sendStringInLoop(std::string &message)
+{
+    if (state_ == kDisconnected) // 连接已经关闭(其他线程投递的send排在connectDestroyed之后) 不能再发送 也不能再排队
+    {
+        LOG_ERROR("disconnected, give up writing");
+        return;
+    }
+    if (zeroCopyEligible(message.size()))
+    {
+        sendSliceInLoop(Slice(std::move(message))); // 零拷贝期间要保留数据
+        return;
+    }
+    bool faultError = false;
+    size_t nwrote = writeIfIdle(message.data(), message.size(), &faultError);
+    size_t remaining = message.size() - nwrote;
+    if (!faultError && remaining > 0)
+    {
+        size_t oldLen = outputBuffer_.readableBytes();
+        if (remaining < Buffer::kMinReferenceBytes)
         {
-            loop_->queueInLoop(
-                std::bind(highWaterMarkCallback_, shared_from_this(), oldLen + remaining));
+            outputBuffer_.append(message.data() + nwrote, remaining);
         }
-        outputBuffer_.append((char *)data + nwrote, remaining);
-        if (!channel_->isWriting())
+        else
+        {
+            outputBuffer_.setChained(true); // 引用只能挂在链式缓冲区上
+            outputBuffer_.append(Slice(std::move(message)).sub(nwrote));
+        }
+        queuedOutput(oldLen, remaining);
+    }
+}
+
+// 和sendInLoop一样 只是剩下的数据按引用排队
+void TcpConnection::sendSliceInLoop(const Slice &slice)
+{
+    if (state_ == kDisconnected) // 连接已经关闭(其他线程投递的send排在connectDestroyed之后) 不能再发送 也不能再排队
+    {
+        LOG_ERROR("disconnected, give up writing");
+        return;
+    }
+    bool faultError = false;
+    size_t nwrote = 0;
+    if (zeroCopyEligible(slice.size()) && slice.holder() && canWriteDirectly()) // 没有持有者时无法保留到内核确认
+    {
+        nwrote = afterWrite(sendZeroCopy(slice), slice.size(), &faultError);
+    }
+    else
+    {
+        nwrote = writeIfIdle(slice.data(), slice.size(), &faultError);
+    }
+    size_t remaining = slice.size() - nwrote;
+    if (!faultError && remaining > 0)
+    {
+        size_t oldLen = outputBuffer_.readableBytes();
+        outputBuffer_.setChained(true); // 引用只能挂在链式缓冲区上
+        outputBuffer_.append(slice.sub(nwrote));
+        queuedOutput(oldLen, remaining);
+    }
+}
+
+// 链式模式的buf直接writev 剩下的块整块移到outputBuffer_ 线性模式的buf按sendInLoop拷贝
+void TcpConnection::sendBufferInLoop(Buffer *buf)
+{
+    if (!buf->isChained())
+    {
+        sendInLoop(buf->peek(), buf->readableBytes());
+        buf->retrieveAll();
+        return;
+    }
+
+    if (state_ == kDisconnected)
+    {
+        LOG_ERROR("disconnected, give up writing");
+        buf->retrieveAll();
+        return;
+    }
+    size_t len = buf->readableBytes();
+    size_t nwrote = 0;
+    bool faultError = false;
+    if (canWriteDirectly() && len > 0)
+    {
+        int savedErrno = 0;
+        ssize_t n = buf->writeFd(channel_.fd(), &savedErrno);
+        errno = savedErrno;
+        nwrote = afterWrite(n, len, &faultError);
+        buf->retrieve(nwrote);
+    }
+
+    size_t remaining = len - nwrote;
+    if (!faultError && remaining > 0)
+    {
+        size_t oldLen = outputBuffer_.readableBytes();
+        outputBuffer_.setChained(true);
+        outputBuffer_.append(buf);
+        queuedOutput(oldLen, remaining);
+    }
+    else
+    {
+        buf->retrieveAll();
+    }
+}
+
+bool TcpConnection::canWriteDirectly() const
+{
+    return !corked_ && !channel_.isWriting() && outputBuffer_.readableBytes() == 0;
+}
+
+// 表示channel_第一次开始写数据或者缓冲区没有待发送数据时直接write 返回写出的字节数
+size_t TcpConnection::writeIfIdle(const void *data, size_t len, bool *faultError)
+{
+    if (!canWriteDirectly())
+    {
+        return 0;
+    }
+    return afterWrite(::write(channel_.fd(), data, len), len, faultError);
+}
+
+ssize_t TcpConnection::sendZeroCopy(const Slice &slice)
+{
+    ssize_t n = ::send(channel_.fd(), slice.data(), slice.size(), MSG_ZEROCOPY);
+    if (n > 0)
+    {
+        // 只发出一部分也占用一个序号 内核引用的是已经发出的那部分
+        zeroCopyPending_.emplace_back(zeroCopySeq_++, slice.holder());
+    }
+    else if (n < 0 && errno == ENOBUFS)
+    {
+        // 锁定的页面超过了optmem_max限制 这次退回普通拷贝
+        n = ::write(channel_.fd(), slice.data(), slice.size());
+    }
+    return n;
+}
+
+// 内核还在引用零拷贝发送的页面 holder不能随连接释放
+// 先取走已经到达的完成通知 剩下的和dup出来的fd一起交给loop的ZeroCopyReaper 等完成通知到齐后再释放
+void TcpConnection::parkZeroCopyPending()
+{
+    handleZeroCopyCompletions();
+    if (zeroCopyPending_.empty())
+    {
+        return;
+    }
+    int fd = ::fcntl(channel_.fd(), F_DUPFD_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        LOG_ERROR("TcpConnection[%s] dup for zerocopy completions error:%d\n", name().c_str(), errno);
+        return;
+    }
+    // dup的fd让socket继续存在 关闭socket_不会再发FIN 这里先关闭连接的两个方向
+    ::shutdown(fd, SHUT_RDWR);
+    ZeroCopyReaper::Pending pending;
+    pending.swap(zeroCopyPending_);
+    loop_->zeroCopyReaper()->park(fd, std::move(pending));
+}
+
+size_t TcpConnection::afterWrite(ssize_t nwrote, size_t len, bool *faultError)
+{
+    if (nwrote >= 0)
+    {
+        if (static_cast<size_t>(nwrote) == len && writeCompleteCallback_)
+        {
+            // 既然在这里数据全部发送完成，就不用再给channel设置epollout事件了
+            queueInLoopSelf([this]() { writeCompleteCallback_(self_); });
+        }
+        return nwrote;
+    }
+
+    if (errno != EWOULDBLOCK) // EWOULDBLOCK表示非阻塞情况下没有数据后的正常返回 等同于EAGAIN
+    {
+        LOG_ERROR("TcpConnection::sendInLoop");
+        if (errno == EPIPE || errno == ECONNRESET) // SIGPIPE RESET
+        {
+            *faultError = true;
+        }
+    }
+    return 0;
+}
+
+// 在本loop中排队只捕获this的任务 连接断开之后丢弃: connectDestroyed排队的释放self_的任务必须是最后一个
+void TcpConnection::queueInLoopSelf(EventLoop::Functor cb)
+{
+    if (state_ == kDisconnected)
+    {
+        return;
+    }
+    loop_->queueInLoop(std::move(cb));
+}
+
+void TcpConnection::queuedOutput(size_t oldLen, size_t appended)
+{
+    if (oldLen + appended >= highWaterMark_ && oldLen < highWaterMark_ && highWaterMarkCallback_)
+    {
+        size_t len = oldLen + appended;
+        queueInLoopSelf([this, len]() { highWaterMarkCallback_(self_, len); });
+    }
+    if (oldLen + appended >= highWaterMark_)
+    {
+        aboveHighWater_ = true;
+    }
+    if (backpressure_ && !throttled_ && oldLen + appended >= backpressureHigh_)
+    {
+        throttled_ = true;
+        throttleUpstreams(true);
+    }
+    loop_->addPendingBytes(appended);
+    if (channel_.isWriting())
+    {
+        return;
+    }
+    if (corked_)
+    {
+        // 本轮循环中第一次攒下数据 处理完活跃事件后统一发出
+        if (!flushQueued_)
+        {
+            flushQueued_ = true;
+            queueInLoopSelf([this]() { flushInLoop(); });
+        }
+    }
+    else
+    {
+        channel_.enableWriting(); // 这里一定要注册channel的写事件 否则poller不会给channel通知epollout
+    }
+}
+
+void TcpConnection::outputDrained()
+{
+    size_t remaining = outputBuffer_.readableBytes();
+    if (aboveHighWater_ && remaining <= lowWaterMark_)
+    {
+        aboveHighWater_ = false;
+        if (lowWaterMarkCallback_)
+        {
+            queueInLoopSelf([this, remaining]() { lowWaterMarkCallback_(self_, remaining); });
+        }
+    }
+    if (throttled_ && remaining <= backpressureLow_)
+    {
+        throttled_ = false;
+        throttleUpstreams(false);
+    }
+}
+
+void TcpConnection::setBackpressure(bool on, size_t highWaterMark, size_t lowWaterMark)
+{
+    if (throttled_)
+    {
+        throttleUpstreams(false); // 换水位之前先恢复已经暂停的上游
+    }
+    backpressure_ = on;
+    backpressureHigh_ = highWaterMark;
+    backpressureLow_ = lowWaterMark;
+    throttled_ = backpressure_ && outputBuffer_.readableBytes() >= backpressureHigh_;
+    if (throttled_)
+    {
+        throttleUpstreams(true);
+    }
+}
+
+void TcpConnection::addUpstream(const TcpConnectionPtr &upstream)
+{
+    if (throttled_)
+    {
+        throttleUpstreams(false); // 上游集合变化 按新的集合重新暂停 保证暂停和恢复成对
+    }
+    upstreams_.push_back(upstream);
+    if (throttled_)
+    {
+        throttleUpstreams(true);
+    }
+}
+
+void TcpConnection::removeUpstream(const TcpConnectionPtr &upstream)
+{
+    if (throttled_)
+    {
+        throttleUpstreams(false);
+    }
+    upstreams_.erase(
+        std::remove_if(upstreams_.begin(), upstreams_.end(),
+                       [&upstream](const std::weak_ptr<TcpConnection> &p) {
+                           TcpConnectionPtr conn = p.lock();
+                           return !conn || conn == upstream;
+                       }),
+        upstreams_.end());
+    if (throttled_)
+    {
+        throttleUpstreams(true);
+    }
+}
+
+void TcpConnection::throttleUpstreams(bool pause)
+{
+    if (upstreams_.empty())
+    {
+        throttleReadInLoop(pause);
+        return;
+    }
+    for (const std::weak_ptr<TcpConnection> &p : upstreams_)
+    {
+        TcpConnectionPtr upstream = p.lock();
+        if (upstream)
         {
-            channel_->enableWriting(); // 这里一定要注册channel的写事件 否则poller不会给channel通知epollout
+            upstream->throttleRead(pause);
         }
     }
 }
 
+void TcpConnection::throttleRead(bool pause)
+{
+    if (loop_->isInLoopThread())
+    {
+        throttleReadInLoop(pause);
+    }
+    else
+    {
+        loop_->runInLoop(
+            std::bind(&TcpConnection::throttleReadInLoop, shared_from_this(), pause));
+    }
+}
+
+void TcpConnection::throttleReadInLoop(bool pause)
+{
+    readPauses_ += pause ? 1 : -1;
+    updateReading();
+}
+
+void TcpConnection::startRead()
+{
+    loop_->runInLoop(
+        std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::stopRead()
+{
+    loop_->runInLoop(
+        std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+}
+
+void TcpConnection::startReadInLoop()
+{
+    reading_ = true;
+    updateReading();
+}
+
+void TcpConnection::stopReadInLoop()
+{
+    reading_ = false;
+    updateReading();
+}
+
+void TcpConnection::updateReading()
+{
+    if (state_ != kConnected && state_ != kDisconnecting) // 还没有注册或者已经关闭
+    {
+        return;
+    }
+    bool want = reading_ && readPauses_ == 0;
+    if (want == channel_.isReading())
+    {
+        return;
+    }
+    // ET模式下重新关注读事件时epoll_ctl会重新检查就绪状态 暂停期间到达的数据会再通知一次
+    if (want)
+    {
+        channel_.enableReading();
+    }
+    else
+    {
+        channel_.disableReading();
+    }
+    if (readStateCallback_)
+    {
+        readStateCallback_(shared_from_this(), want);
+    }
+}
+
+void TcpConnection::setCork(bool on)
+{
+    corked_ = on;
+    if (!on && state_ != kConnecting)
+    {
+        flushInLoop();
+    }
+}
+
+void TcpConnection::flush()
+{
+    if (loop_->isInLoopThread())
+    {
+        flushInLoop();
+    }
+    else
+    {
+        // 之前其他线程的send也是投递到loop线程执行的 flush排在它们后面
+        loop_->runInLoop(
+            std::bind(&TcpConnection::flushInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::flushInLoop()
+{
+    flushQueued_ = false;
+    size_t len = outputBuffer_.readableBytes();
+    if (state_ == kDisconnected || channel_.isWriting() || len == 0)
+    {
+        return; // 已经在等可写事件的话由handleWrite继续发送
+    }
+
+    int savedErrno = 0;
+    bool faultError = false;
+    ssize_t n = outputBuffer_.writeFd(channel_.fd(), &savedErrno); // 链式模式下是一次writev
+    errno = savedErrno;
+    size_t nwrote = afterWrite(n, len, &faultError);
+    if (nwrote > 0)
+    {
+        outputBuffer_.retrieve(nwrote);
+        loop_->addPendingBytes(-static_cast<int64_t>(nwrote));
+        lastActive_ = loop_->pollReturnTime();
+        outputDrained();
+    }
+    if (faultError)
+    {
+        return;
+    }
+    if (outputBuffer_.readableBytes() > 0)
+    {
+        channel_.enableWriting();
+    }
+    else if (state_ == kDisconnecting)
+    {
+        shutdownInLoop();
+    }
+}
+
+void TcpConnection::setTcpNoDelay(bool on)
+{
+    socket_.setTcpNoDelay(on);
+}
+
 void TcpConnection::shutdown()
 {
     if (state_ == kConnected)
@@ -149,11 +657,34 @@ void TcpConnection::shutdown()
     }
 }
 
+void TcpConnection::forceClose()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        setState(kDisconnecting);
+        loop_->queueInLoop(
+            std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::forceCloseInLoop()
+{
+    if (state_ == kConnected || state_ == kDisconnecting)
+    {
+        handleClose();
+    }
+}
+
 void TcpConnection::shutdownInLoop()
 {
-    if (!channel_->isWriting()) // 说明当前outputBuffer_的数据全部向外发送完成
+    if (!channel_.isWriting() && outputBuffer_.readableBytes() > 0)
     {
-        socket_->shutdownWrite(); 
+        flushInLoop(); // cork模式下还有攒着的数据 先发出 发完后再shutdown
+        return;
+    }
+    if (!channel_.isWriting()) // 说明当前outputBuffer_的数据全部向外发送完成
+    {
+        socket_.shutdownWrite(); 
     }
 }
 
@@ -161,11 +692,30 @@ void TcpConnection::shutdownInLoop()
 void TcpConnection::connectEstablished()
 {
     setState(kConnected);
-    channel_->tie(shared_from_this());
-    channel_->enableReading(); // 向poller注册channel的EPOLLIN读事件
-    
+    lastActive_ = Timestamp::now();
+    // 本loop持有的引用 事件回调直接传self_ 不用每次shared_from_this 见connectDestroyed
+    self_ = shared_from_this();
+    if (ioBudget_ > 0 && loop_->edgeTriggeredSupported())
+    {
+        channel_.enableEdgeTriggered(); // EPOLLIN|EPOLLOUT|EPOLLET一次注册 之后切换写事件不再epoll_ctl
+    }
+    if (loop_->socketBusyPollMicros() > 0)
+    {
+        socket_.setBusyPoll(loop_->socketBusyPollMicros());
+    }
+    if (zeroCopyThreshold_ > 0 && !socket_.setZeroCopy(true))
+    {
+        zeroCopyThreshold_ = 0; // 内核不支持 退回普通发送
+    }
+    // 向poller注册channel的EPOLLIN读事件 建立之前已经被暂停(stopRead或者背压)时保持暂停 恢复时由updateReading注册
+    // 初始状态不是暂停/恢复的切换 不经过updateReading 不触发readStateCallback_
+    if (reading_ && readPauses_ == 0)
+    {
+        channel_.enableReading();
+    }
+
     // 新连接建立 执行回调
-    connectionCallback_(shared_from_this());
+    connectionCallback_(self_);
 }
 // 连接销毁
 void TcpConnection::connectDestroyed()
@@ -173,21 +723,61 @@ void TcpConnection::connectDestroyed()
     if (state_ == kConnected)
     {
         setState(kDisconnected);
-        channel_->disableAll(); // 把channel的所有感兴趣的事件从poller中删除掉
-        connectionCallback_(shared_from_this());
+        channel_.disableAll(); // 把channel的所有感兴趣的事件从poller中删除掉
+        connectionCallback_(self_);
+    }
+    else if (state_ != kDisconnected) // shutdown之后还没关闭就被TcpServer销毁 同样不能再发送和排队
+    {
+        setState(kDisconnected);
+        channel_.disableAll();
+    }
+    if (throttled_)
+    {
+        throttled_ = false;
+        throttleUpstreams(false); // 没发完的数据随连接一起丢弃 不能让上游一直暂停
+    }
+    loop_->addConnections(-1); // 创建者在分发时计入(见TcpServer::newConnectionInLoop)
+    loop_->addPendingBytes(-static_cast<int64_t>(outputBuffer_.readableBytes())); // 没发完的数据随连接一起丢弃
+    // 缓冲区的存储现在就还给本loop的BufferPool 用户保存的TcpConnectionPtr可能在loop析构之后才释放 析构时不能再访问pool
+    inputBuffer_.retrieveAll();
+    outputBuffer_.retrieveAll();
+    channel_.remove(); // 把channel从poller中删除掉
+    if (!zeroCopyPending_.empty())
+    {
+        parkZeroCopyPending();
+    }
+
+    // 延迟释放本loop持有的引用: 之前在本loop中排队的捕获this的回调都在它前面执行
+    // 连接已经断开、channel_已经移除 之后不会再有新的事件 queueInLoopSelf也不再排队 释放后对象可以安全析构
+    if (self_)
+    {
+        loop_->queueInLoop([this]() {
+            TcpConnectionPtr self;
+            self.swap(self_); // 先移出成员 最后一个引用在局部变量析构时释放
+        });
     }
-    channel_->remove(); // 把channel从poller中删除掉
 }
 
 // 读是相对服务器而言的 当对端客户端有数据到达 服务器端检测到EPOLLIN 就会触发该fd上的回调 handleRead取读走对端发来的数据
 void TcpConnection::handleRead(Timestamp receiveTime)
 {
+    if (!channel_.isReading()) // 本轮中被其他连接的背压暂停了 或者是暂停前排队的ET续读
+    {
+        return;
+    }
+    if (channel_.isEdgeTriggered())
+    {
+        handleReadEdgeTriggered(receiveTime);
+        return;
+    }
+
     int savedErrno = 0;
-    ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+    ssize_t n = inputBuffer_.readFd(channel_.fd(), &savedErrno, loop_->receiveArena());
     if (n > 0) // 有数据到达
     {
-        // 已建立连接的用户有可读事件发生了 调用用户传入的回调操作onMessage shared_from_this就是获取了TcpConnection的智能指针
-        messageCallback_(shared_from_this(), &inputBuffer_, receiveTime);
+        lastActive_ = receiveTime;
+        // 已建立连接的用户有可读事件发生了 调用用户传入的回调操作onMessage self_是本loop持有的TcpConnection的智能指针
+        messageCallback_(self_, &inputBuffer_, receiveTime);
     }
     else if (n == 0) // 客户端断开
     {
@@ -201,23 +791,108 @@ void TcpConnection::handleRead(Timestamp receiveTime)
     }
 }
 
+/**
+ * ET模式：一次读到EAGAIN为止 否则剩下的数据不会再有通知
+ * 读满ioBudget_后把剩下的读取放到本轮循环末尾 先让其他活跃连接处理 保证公平
+ **/
+void TcpConnection::handleReadEdgeTriggered(Timestamp receiveTime)
+{
+    if (state_ == kDisconnected) // 排队期间连接已经关闭
+    {
+        return;
+    }
+
+    int savedErrno = 0;
+    size_t total = 0;
+    bool peerClosed = false;
+    bool faultError = false;
+    while (total < ioBudget_)
+    {
+        ssize_t n = inputBuffer_.readFd(channel_.fd(), &savedErrno, loop_->receiveArena());
+        if (n > 0)
+        {
+            total += n;
+        }
+        else if (n == 0)
+        {
+            peerClosed = true;
+            break;
+        }
+        else
+        {
+            faultError = (savedErrno != EAGAIN && savedErrno != EWOULDBLOCK);
+            break;
+        }
+    }
+
+    if (total > 0)
+    {
+        lastActive_ = receiveTime;
+        messageCallback_(self_, &inputBuffer_, receiveTime);
+    }
+
+    if (peerClosed)
+    {
+        handleClose();
+    }
+    else if (faultError)
+    {
+        errno = savedErrno;
+        LOG_ERROR("TcpConnection::handleReadEdgeTriggered");
+        handleError();
+    }
+    else if (total >= ioBudget_ && channel_.isReading())
+    {
+        queueInLoopSelf([this, receiveTime]() { handleRead(receiveTime); });
+    }
+}
+
 void TcpConnection::handleWrite()
 {
-    if (channel_->isWriting())
+    if (channel_.isWriting())
     {
         int savedErrno = 0;
-        ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
-        if (n > 0)
+        ssize_t n = 0;
+        size_t total = 0;
+        // LT模式只写一次 ET模式写到EAGAIN、写完或者用完ioBudget_为止
+        do
         {
-            outputBuffer_.retrieve(n);//从缓冲区读取reable区域的数据移动readindex下标
-            if (outputBuffer_.readableBytes() == 0)
+            // 队首是足够大的引用块时单独零拷贝发送 否则writev
+            Slice front = zeroCopyThreshold_ > 0 ? outputBuffer_.frontReference() : Slice();
+            if (zeroCopyEligible(front.size()))
+            {
+                n = sendZeroCopy(front);
+                savedErrno = n < 0 ? errno : 0;
+            }
+            else
             {
-                channel_->disableWriting();
+                n = outputBuffer_.writeFd(channel_.fd(), &savedErrno);
+            }
+            if (n > 0)
+            {
+                outputBuffer_.retrieve(n);//从缓冲区读取reable区域的数据移动readindex下标
+                loop_->addPendingBytes(-n);
+                total += n;
+            }
+        } while (n > 0 && channel_.isEdgeTriggered()
+                 && outputBuffer_.readableBytes() > 0 && total < ioBudget_);
+
+        if (total > 0)
+        {
+            lastActive_ = loop_->pollReturnTime();
+            outputDrained();
+            if (outputBuffer_.readableBytes() > 0 && channel_.isEdgeTriggered() && n > 0)
+            {
+                // 预算用完但socket仍然可写 ET不会再通知 放到本轮末尾继续写
+                queueInLoopSelf([this]() { handleWrite(); });
+            }
+            else if (outputBuffer_.readableBytes() == 0)
+            {
+                channel_.disableWriting();
                 if (writeCompleteCallback_)
                 {
                     // TcpConnection对象在其所在的subloop中 向pendingFunctors_中加入回调
-                    loop_->queueInLoop(
-                        std::bind(writeCompleteCallback_, shared_from_this()));
+                    queueInLoopSelf([this]() { writeCompleteCallback_(self_); });
                 }
                 if (state_ == kDisconnecting)
                 {
@@ -225,22 +900,22 @@ void TcpConnection::handleWrite()
                 }
             }
         }
-        else
+        else if (!channel_.isEdgeTriggered() || (savedErrno != EAGAIN && savedErrno != EWOULDBLOCK))
         {
             LOG_ERROR("TcpConnection::handleWrite");
         }
     }
     else
     {
-        LOG_ERROR("TcpConnection fd=%d is down, no more writing", channel_->fd());
+        LOG_ERROR("TcpConnection fd=%d is down, no more writing", channel_.fd());
     }
 }
 
 void TcpConnection::handleClose()
 {
-    LOG_INFO("TcpConnection::handleClose fd=%d state=%d\n", channel_->fd(), (int)state_);
+    LOG_INFO("TcpConnection::handleClose fd=%d state=%d\n", channel_.fd(), (int)state_);
     setState(kDisconnected);
-    channel_->disableAll();
+    channel_.disableAll();
 
     TcpConnectionPtr connPtr(shared_from_this());
     connectionCallback_(connPtr); // 连接回调
@@ -249,10 +924,12 @@ void TcpConnection::handleClose()
 
 void TcpConnection::handleError()
 {
+    // 零拷贝的完成通知放在错误队列里 同样以EPOLLERR通知
+    bool completions = !zeroCopyPending_.empty() && handleZeroCopyCompletions();
     int optval;
     socklen_t optlen = sizeof optval;
     int err = 0;
-    if (::getsockopt(channel_->fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    if (::getsockopt(channel_.fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
     {
         err = errno;
     }
@@ -260,7 +937,28 @@ void TcpConnection::handleError()
     {
         err = optval;
     }
-    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d\n", name_.c_str(), err);
+    if (completions && err == 0)
+    {
+        return;
+    }
+    LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR:%d\n", name().c_str(), err);
+}
+
+bool TcpConnection::handleZeroCopyCompletions()
+{
+    bool copied = false;
+    bool completed = ZeroCopyReaper::reapCompletions(channel_.fd(), &zeroCopyPending_, &copied);
+    if (copied && zeroCopyThreshold_ > 0)
+    {
+        // 内核最后还是做了拷贝(回环网卡或者网卡不支持分散聚合) 零拷贝只剩下额外开销
+        LOG_INFO("TcpConnection[%s] zerocopy fell back to copying, disabled\n", name().c_str());
+        zeroCopyThreshold_ = 0;
+    }
+    if (completed && zeroCopyPending_.empty() && zeroCopyCompleteCallback_)
+    {
+        zeroCopyCompleteCallback_(self_);
+    }
+    return completed;
 }
 
 // 新增的零拷贝发送函数
@@ -283,19 +981,23 @@ void TcpConnection::sendFileInLoop(int fileDescriptor, off_t offset, size_t coun
     size_t remaining = count; // 还要多少数据要发送
     bool faultError = false; // 错误的标志位
 
-    if (state_ == kDisconnecting) { // 表示此时连接已经断开就不需要发送数据了
+    if (state_ == kDisconnected || state_ == kDisconnecting) { // 表示此时连接已经断开就不需要发送数据了
         LOG_ERROR("disconnected, give up writing");
         return;
     }
 
+    if (corked_) {
+        flushInLoop(); // 先发出cork模式下攒着的数据 保证顺序
+    }
+
     // 表示Channel第一次开始写数据或者outputBuffer缓冲区中没有数据
-    if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0) {
-        bytesSent = sendfile(socket_->fd(), fileDescriptor, &offset, remaining);
+    if (!channel_.isWriting() && outputBuffer_.readableBytes() == 0) {
+        bytesSent = sendfile(socket_.fd(), fileDescriptor, &offset, remaining);
         if (bytesSent >= 0) {
             remaining -= bytesSent;
             if (remaining == 0 && writeCompleteCallback_) {
                 // remaining为0意味着数据正好全部发送完，就不需要给其设置写事件的监听。
-                loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                queueInLoopSelf([this]() { writeCompleteCallback_(self_); });
             }
         } else { // bytesSent < 0
             if (errno != EWOULDBLOCK) { // 如果是非阻塞没有数据返回错误这个是正常显现等同于EAGAIN，否则就异常情况
@@ -1,9 +1,12 @@
 #include <functional>
+#include <mutex>
+#include <condition_variable>
 #include <string.h>
 
 #include "TcpServer.h"
 #include "Logger.h"
 #include "TcpConnection.h"
+#include "ConnectionPool.h"
 
 static EventLoop *CheckLoopNotNull(EventLoop *loop)
 {
@@ -21,12 +24,23 @@ TcpServer::TcpServer(EventLoop *loop,
     : loop_(CheckLoopNotNull(loop))
     , ipPort_(listenAddr.toIpPort())
     , name_(nameArg)
+    , connNamePrefix_(std::make_shared<const std::string>(nameArg + "-" + ipPort_ + "#"))
     , acceptor_(new Acceptor(loop, listenAddr, option == kReusePort))
     , threadPool_(new EventLoopThreadPool(loop, name_))
     , connectionCallback_()
     , messageCallback_()
-    , nextConnId_(1)
     , started_(0)
+    , perLoopAcceptors_(false)
+    , acceptBatch_(Acceptor::kDefaultAcceptBatch)
+    , idleTimeout_(0.0)
+    , edgeTriggered_(false)
+    , ioBudget_(kDefaultIoBudget)
+    , chainedOutput_(false)
+    , cork_(false)
+    , backpressureHigh_(0)
+    , backpressureLow_(0)
+    , zeroCopyThreshold_(0)
+    , reservedConnections_(0)
 {
     // 当有新用户连接时，Acceptor类中绑定的acceptChannel_会有读事件发生，
     // 执行handleRead()调用TcpServer::newConnection回调
@@ -36,13 +50,43 @@ TcpServer::TcpServer(EventLoop *loop,
 
 TcpServer::~TcpServer()
 {
-    for(auto &item : connections_)
+    /**
+     * subloop的Acceptor要在各自的loop线程中析构(从Poller中移除Channel)
+     * 它们的回调指向this 必须等全部析构完再返回 否则subloop在这之前accept的连接会回调到已经析构的TcpServer
+     * 析构之后不会再有新连接 下面销毁连接的任务排在所有已经建立的连接之后
+     **/
+    std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+    if (!loopAcceptors_.empty())
     {
-        TcpConnectionPtr conn(item.second);
-        item.second.reset();    // 把原始的智能指针复位 让栈空间的TcpConnectionPtr conn指向该对象 当conn出了其作用域 即可释放智能指针指向的对象
-        // 销毁连接
-        conn->getLoop()->runInLoop(
-            std::bind(&TcpConnection::connectDestroyed, conn));
+        std::mutex mutex;
+        std::condition_variable cond;
+        size_t remaining = loopAcceptors_.size();
+        for (size_t i = 0; i < loopAcceptors_.size(); ++i)
+        {
+            Acceptor *acceptor = loopAcceptors_[i].release();
+            loops[i]->runInLoop([acceptor, &mutex, &cond, &remaining]() {
+                delete acceptor;
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--remaining == 0)
+                {
+                    cond.notify_one();
+                }
+            });
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&remaining]() { return remaining == 0; });
+    }
+
+    // 每个分片在自己的loop中取出全部连接并销毁 分片随最后一个任务释放
+    for (size_t i = 0; i < connectionShards_.size(); ++i)
+    {
+        std::shared_ptr<ConnectionSlots> shard = connectionShards_[i];
+        loops[i]->runInLoop([shard]() {
+            for (const TcpConnectionPtr &conn : shard->takeAll())
+            {
+                conn->connectDestroyed();
+            }
+        });
     }
 }
 
@@ -59,65 +103,168 @@ void TcpServer::start()
     if (started_.fetch_add(1) == 0)    // 防止一个TcpServer对象被start多次
     {
         threadPool_->start(threadInitCallback_);    // 启动底层的loop线程池
-        loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        std::vector<EventLoop *> loops = threadPool_->getAllLoops();
+        if (loops.size() > SlotId::kMaxTag + 1)
+        {
+            LOG_FATAL("TcpServer::start [%s] too many loops: %lu\n", name_.c_str(), loops.size());
+        }
+        for (size_t i = 0; i < loops.size(); ++i)
+        {
+            std::shared_ptr<ConnectionSlots> shard(new ConnectionSlots(static_cast<uint32_t>(i)));
+            connectionShards_.push_back(shard);
+            if (reservedConnections_ > 0)
+            {
+                ConnectionPool *pool = loops[i]->connectionPool().get();
+                size_t n = reservedConnections_;
+                loops[i]->runInLoop([pool, n]() { pool->reserve(n); });
+            }
+
+            std::shared_ptr<LoopContext> ctx(new LoopContext);
+            ctx->loop = loops[i];
+            ctx->shard = shard;
+            if (idleTimeout_ > 0.0)
+            {
+                ctx->wheel.reset(new TimingWheel(loops[i], idleTimeout_));
+                loops[i]->runInLoop(std::bind(&TimingWheel::start, ctx->wheel));
+            }
+            ctx->namePrefix = connNamePrefix_;
+            ctx->connectionCallback = connectionCallback_;
+            ctx->messageCallback = messageCallback_;
+            ctx->writeCompleteCallback = writeCompleteCallback_;
+            ctx->zeroCopyCompleteCallback = zeroCopyCompleteCallback_;
+            // 关闭回调同样不捕获this: 分片由析构时排队的任务持有到本loop的连接全部销毁 名字前缀由连接自己持有
+            // 只捕获两个裸指针 放得进std::function的内部存储 复制给每个连接时不需要单独分配
+            ConnectionSlots *slots = shard.get();
+            const std::string *namePrefix = connNamePrefix_.get();
+            ctx->closeCallback = [slots, namePrefix](const TcpConnectionPtr &connection) {
+                removeConnection(slots, namePrefix, connection);
+            };
+            ctx->edgeTriggered = edgeTriggered_;
+            ctx->ioBudget = ioBudget_;
+            ctx->chainedOutput = chainedOutput_;
+            ctx->cork = cork_;
+            ctx->backpressureHigh = backpressureHigh_;
+            ctx->backpressureLow = backpressureLow_;
+            ctx->zeroCopyThreshold = zeroCopyThreshold_;
+            loopContexts_[loops[i]] = ctx;
+        }
+        if (perLoopAcceptors_ && numThreads_ > 0)
+        {
+            // 每个subloop一个SO_REUSEPORT监听socket 新连接直接在本loop中建立
+            // mainloop的acceptor_已经bind但不listen 不会被内核分配连接
+            for (EventLoop *ioLoop : threadPool_->getAllLoops())
+            {
+                // 用acceptor_实际绑定的地址 端口为0时各个监听socket也绑定在内核给acceptor_分配的同一个端口上
+                Acceptor *acceptor = new Acceptor(ioLoop, acceptor_->localAddr(), true);
+                acceptor->setAcceptBatch(acceptBatch_);
+                acceptor->setNewConnectionCallback(
+                    std::bind(&TcpServer::newConnectionInLoop, this, acceptor, ioLoop,
+                              std::placeholders::_1, std::placeholders::_2));
+                loopAcceptors_.push_back(std::unique_ptr<Acceptor>(acceptor));
+                ioLoop->runInLoop(std::bind(&Acceptor::listen, acceptor));
+            }
+        }
+        else
+        {
+            loop_->runInLoop(std::bind(&Acceptor::listen, acceptor_.get()));
+        }
     }
 }
 
 // 有一个新用户连接，acceptor会执行这个回调操作，负责将mainLoop接收到的请求连接(acceptChannel_会有读事件发生)通过回调轮询分发给subLoop去处理
 void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
 {
-   // 轮询算法 选择一个subLoop 来管理connfd对应的channel
-    EventLoop *ioLoop = threadPool_->getNextLoop();
-    char buf[64] = {0};
-    snprintf(buf, sizeof buf, "-%s#%d", ipPort_.c_str(), nextConnId_);
-    ++nextConnId_;  // 这里没有设置为原子类是因为其只在mainloop中执行 不涉及线程安全问题
-    std::string connName = name_ + buf;
+   // 按分发策略(默认轮询) 选择一个subLoop 来管理connfd对应的channel
+    EventLoop *ioLoop = threadPool_->getNextLoop(peerAddr);
+    newConnectionInLoop(acceptor_.get(), ioLoop, sockfd, peerAddr);
+}
 
-    LOG_INFO("TcpServer::newConnection [%s] - new connection [%s] from %s\n",
-             name_.c_str(), connName.c_str(), peerAddr.toIpPort().c_str());
+// 在mainloop(分发模式)或者ioLoop自己(每个loop各自accept的模式)中调用
+void TcpServer::newConnectionInLoop(Acceptor *acceptor, EventLoop *ioLoop, int sockfd, const InetAddress &peerAddr)
+{
+    // 连接名和ID在ioLoop登记时才确定 这里不拼接名字
+    LOG_INFO("TcpServer::newConnection [%s] - new connection fd=%d from %s\n",
+             name_.c_str(), sockfd, peerAddr.toIpPort().c_str());
     
-    // 通过sockfd获取其绑定的本机的ip地址和端口信息
-    sockaddr_in local;
-    ::memset(&local, 0, sizeof(local));
-    socklen_t addrlen = sizeof(local);
-    if(::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0)
+    // 监听在具体地址上时本端地址就是监听地址 否则(INADDR_ANY)通过sockfd获取其绑定的本机的ip地址和端口信息
+    InetAddress localAddr(acceptor->localAddr());
+    if (!acceptor->localAddrKnown())
+    {
+        sockaddr_in local;
+        ::memset(&local, 0, sizeof(local));
+        socklen_t addrlen = sizeof(local);
+        if(::getsockname(sockfd, (sockaddr *)&local, &addrlen) < 0)
+        {
+            LOG_ERROR("sockets::getLocalAddr");
+        }
+        localAddr.setSockAddr(local);
+    }
+    // 在分发线程中立即计入所属loop的连接数 否则突发的新连接会看到过期的负载
+    ioLoop->addConnections(1);
+    std::shared_ptr<const LoopContext> ctx = loopContexts_.find(ioLoop)->second;
+    if (ioLoop->isInLoopThread())
+    {
+        establishConnection(ctx, sockfd, localAddr, peerAddr);
+    }
+    else
     {
-        
-        LOG_ERROR("sockets::getLocalAddr");
+        // 连接池只能在所属loop线程中使用 对象到ioLoop中再创建 任务只持有ctx 不捕获this
+        ioLoop->queueInLoop([ctx, sockfd, localAddr, peerAddr]() {
+            establishConnection(ctx, sockfd, localAddr, peerAddr);
+        });
     }
+}
 
-    InetAddress localAddr(local);
-    TcpConnectionPtr conn(new TcpConnection(ioLoop,
-                                            connName,
-                                            sockfd,
-                                            localAddr,
-                                            peerAddr));
-    connections_[connName] = conn;
+void TcpServer::establishConnection(const std::shared_ptr<const LoopContext> &ctx, int sockfd,
+                                    const InetAddress &localAddr, const InetAddress &peerAddr)
+{
+    // 控制块和对象(连同Socket、Channel)一次从本loop的连接池分配
+    TcpConnectionPtr conn = std::allocate_shared<TcpConnection>(
+        ConnectionAllocator<TcpConnection>(ctx->loop->connectionPool()),
+        ctx->loop, ctx->namePrefix, sockfd, localAddr, peerAddr);
     // 下面的回调都是用户设置给TcpServer => TcpConnection的，至于Channel绑定的则是TcpConnection设置的四个，handleRead,handleWrite... 这下面的回调用于handlexxx函数中
-    conn->setConnectionCallback(connectionCallback_);
-    conn->setMessageCallback(messageCallback_);
-    conn->setWriteCompleteCallback(writeCompleteCallback_);
+    conn->setConnectionCallback(ctx->connectionCallback);
+    conn->setMessageCallback(ctx->messageCallback);
+    conn->setWriteCompleteCallback(ctx->writeCompleteCallback);
+    conn->setEdgeTriggered(ctx->edgeTriggered, ctx->ioBudget);
+    conn->setChainedOutput(ctx->chainedOutput);
+    conn->setCork(ctx->cork);
+    if (ctx->backpressureHigh > 0)
+    {
+        conn->setBackpressure(true, ctx->backpressureHigh, ctx->backpressureLow);
+    }
+    conn->setZeroCopy(ctx->zeroCopyThreshold > 0, ctx->zeroCopyThreshold);
+    conn->setZeroCopyCompleteCallback(ctx->zeroCopyCompleteCallback);
+    conn->setCloseCallback(ctx->closeCallback);
 
-    // 设置了如何关闭连接的回调
-    conn->setCloseCallback(
-        std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
- 
-    ioLoop->runInLoop(
-        std::bind(&TcpConnection::connectEstablished, conn));
+    // 登记到本loop的分片、建立连接、加入时间轮
+    conn->setId(ctx->shard->insert(conn));
+    conn->connectEstablished();
+    if (ctx->wheel)
+    {
+        ctx->wheel->add(conn);
+    }
 }
 
-void TcpServer::removeConnection(const TcpConnectionPtr &conn)
+TcpConnectionPtr TcpServer::findConnection(uint64_t id) const
 {
-    loop_->runInLoop(
-        std::bind(&TcpServer::removeConnectionInLoop, this, conn));
+    uint32_t tag = SlotId::tag(id);
+    if (tag >= connectionShards_.size())
+    {
+        return TcpConnectionPtr();
+    }
+    TcpConnectionPtr *conn = connectionShards_[tag]->find(id);
+    return conn ? *conn : TcpConnectionPtr();
 }
 
-void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
+// 在连接所属的ioLoop中调用 从本loop的分片中删除 不需要加锁也不需要回到mainloop
+void TcpServer::removeConnection(ConnectionSlots *shard, const std::string *namePrefix, const TcpConnectionPtr &conn)
 {
-    LOG_INFO("TcpServer::removeConnectionInLoop [%s] - connection %s\n",
-             name_.c_str(), conn->name().c_str());
+    const uint64_t id = conn->id();
+    LOG_INFO("TcpServer::removeConnection - connection %s%u.%u.%u\n",
+             namePrefix->c_str(), SlotId::tag(id), SlotId::index(id), SlotId::generation(id));
 
-    connections_.erase(conn->name());
+    shard->erase(id);
     EventLoop *ioLoop = conn->getLoop();
     ioLoop->queueInLoop(
         std::bind(&TcpConnection::connectDestroyed, conn));
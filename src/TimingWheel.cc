@@ -0,0 +1,74 @@
+#include <math.h>
+#include <algorithm>
+
+#include "TimingWheel.h"
+#include "TcpConnection.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+TimingWheel::TimingWheel(EventLoop *loop, double idleTimeoutSeconds)
+    : loop_(loop)
+    , idleTimeout_(idleTimeoutSeconds)
+    , tick_(std::min(1.0, idleTimeoutSeconds)) // 精度1秒 超时小于1秒时按超时时间转动
+    , buckets_(static_cast<size_t>(ceil(idleTimeoutSeconds / tick_)) + 1)
+    , cursor_(0)
+    , size_(0)
+{
+}
+
+void TimingWheel::start()
+{
+    // 定时器只持有weak_ptr TcpServer析构后时间轮随之释放 回调自动失效
+    std::weak_ptr<TimingWheel> weakSelf(shared_from_this());
+    loop_->runEvery(tick_, [weakSelf]() {
+        std::shared_ptr<TimingWheel> wheel = weakSelf.lock();
+        if (wheel)
+        {
+            wheel->onTick();
+        }
+    });
+}
+
+void TimingWheel::add(const TcpConnectionPtr &conn)
+{
+    place(conn, buckets_.size() - 1);
+    ++size_;
+}
+
+void TimingWheel::place(const WeakConnectionPtr &conn, size_t ticksFromNow)
+{
+    buckets_[(cursor_ + ticksFromNow) % buckets_.size()].push_back(conn);
+}
+
+void TimingWheel::onTick()
+{
+    cursor_ = (cursor_ + 1) % buckets_.size();
+    expiring_.swap(buckets_[cursor_]);
+
+    Timestamp now(loop_->pollReturnTime());
+    for (const WeakConnectionPtr &weakConn : expiring_)
+    {
+        TcpConnectionPtr conn(weakConn.lock());
+        if (!conn || !conn->connected())
+        {
+            --size_;
+            continue;
+        }
+
+        double idle = timeDifference(now, conn->lastActiveTime());
+        if (idle >= idleTimeout_)
+        {
+            LOG_INFO("TimingWheel::onTick [%s] idle %.1fs, force close\n", conn->name().c_str(), idle);
+            --size_;
+            conn->forceClose();
+        }
+        else
+        {
+            // 期间有过收发 按剩余的空闲时间重新放入时间轮
+            size_t ticks = static_cast<size_t>(ceil((idleTimeout_ - idle) / tick_));
+            ticks = std::max<size_t>(1, std::min(ticks, buckets_.size() - 1));
+            place(weakConn, ticks);
+        }
+    }
+    expiring_.clear();
+}
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h> // sock_extended_err
+
+#include "ZeroCopyReaper.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+const double ZeroCopyReaper::kReapInterval = 0.1;
+
+ZeroCopyReaper::ZeroCopyReaper(EventLoop *loop)
+    : loop_(loop)
+    , scheduled_(false)
+{
+}
+
+ZeroCopyReaper::~ZeroCopyReaper()
+{
+    // 没有loop可以继续等待了 这时释放holder 内核发出的可能是之后被改写的内容
+    for (Parked &p : parked_)
+    {
+        LOG_INFO("ZeroCopyReaper dropping %zu pending sends on fd=%d\n", p.pending.size(), p.fd);
+        ::close(p.fd);
+    }
+}
+
+void ZeroCopyReaper::park(int fd, Pending pending)
+{
+    Parked p;
+    p.fd = fd;
+    p.pending = std::move(pending);
+    parked_.push_back(std::move(p));
+    if (!scheduled_)
+    {
+        scheduled_ = true;
+        loop_->runAfter(kReapInterval, [this]() { reap(); });
+    }
+}
+
+void ZeroCopyReaper::reap()
+{
+    scheduled_ = false;
+    for (size_t i = 0; i < parked_.size();)
+    {
+        bool copied = false;
+        reapCompletions(parked_[i].fd, &parked_[i].pending, &copied);
+        if (parked_[i].pending.empty())
+        {
+            ::close(parked_[i].fd);
+            parked_[i] = std::move(parked_.back()); // 顺序无关 和最后一个交换后删除
+            parked_.pop_back();
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    if (!parked_.empty())
+    {
+        scheduled_ = true;
+        loop_->runAfter(kReapInterval, [this]() { reap(); });
+    }
+}
+
+bool ZeroCopyReaper::reapCompletions(int fd, Pending *pending, bool *copied)
+{
+    bool completed = false;
+    char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+    for (;;)
+    {
+        msghdr msg;
+        ::memset(&msg, 0, sizeof msg);
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof control;
+        if (::recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            break; // EAGAIN 错误队列已经取空
+        }
+        for (cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            bool recvErr = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                        || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+            if (!recvErr)
+            {
+                continue;
+            }
+            const sock_extended_err *ee = reinterpret_cast<const sock_extended_err *>(CMSG_DATA(cm));
+            if (ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY || ee->ee_errno != 0)
+            {
+                continue;
+            }
+            // 序号在[ee_info, ee_data]之间的发送已经完成 序号会回绕 按差值比较
+            const uint32_t lo = ee->ee_info;
+            const uint32_t hi = ee->ee_data;
+            pending->erase(
+                std::remove_if(pending->begin(), pending->end(),
+                               [lo, hi](const std::pair<uint32_t, std::shared_ptr<const void>> &p) {
+                                   return static_cast<int32_t>(p.first - lo) >= 0
+                                       && static_cast<int32_t>(hi - p.first) >= 0;
+                               }),
+                pending->end());
+            completed = true;
+            if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            {
+                *copied = true;
+            }
+        }
+    }
+    return completed;
+}